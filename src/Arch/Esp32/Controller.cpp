@@ -12,9 +12,12 @@
 
 #include <HSPI/Controller.h>
 #include <HSPI/Device.h>
+#include <HSPI/Crc32.h>
 #include <driver/spi_master.h>
 #include <esp_intr_alloc.h>
 #include <Platform/Timers.h>
+#include <Platform/System.h>
+#include <esp_systemapi.h>
 #include <debug_progmem.h>
 
 namespace HSPI
@@ -41,12 +44,27 @@ volatile Controller::Stats Controller::stats;
 #endif
 
 struct EspTransaction {
-	spi_transaction_ext_t ext;
+	spi_transaction_ext_t ext; ///< MUST be first
+	Request* request;		   ///< Request this transaction belongs to
+	uint16_t inOffset;		   ///< Where to write incoming data
+	uint16_t inlen;			   ///< Incoming data for this transaction
+	int8_t buffer;			   ///< Bounce buffer in use, -1 if none
+	bool first;				   ///< First transaction for request
+	bool last;				   ///< Final transaction for request
 };
 
+namespace
+{
+bool IRAM_ATTR isDmaCapable(const void* ptr)
+{
+	return esp_ptr_dma_capable(ptr) && IS_ALIGNED(ptr);
+}
+
+} // namespace
+
 Controller::~Controller()
 {
-	delete esp_trans;
+	delete[] esp_trans;
 }
 
 bool Controller::begin()
@@ -76,7 +94,7 @@ bool Controller::begin()
 	}
 
 	if(esp_trans == nullptr) {
-		esp_trans = new EspTransaction{};
+		esp_trans = new EspTransaction[transactionSlots]{};
 	}
 
 	flags.initialised = true;
@@ -90,6 +108,7 @@ void Controller::end()
 	}
 
 	flags.initialised = false;
+	parkTimer.stop();
 
 	// Check all devices have been released
 	assert(normalDevices == 0);
@@ -97,15 +116,26 @@ void Controller::end()
 
 void IRAM_ATTR Controller::pre_transfer_callback(spi_transaction_t* t)
 {
+	auto et = reinterpret_cast<EspTransaction*>(t);
+	if(!et->first) {
+		return;
+	}
+
 	auto self = static_cast<Controller*>(t->user);
-	auto req = self->trans.request;
-	req->device->transferStarting(*req);
+	auto& req = *et->request;
+	auto& dev = *req.device;
+	if(self->selectDeviceCallback) {
+		self->selectDeviceCallback(dev.chipSelect, true);
+	}
+	dev.transferStarting(req);
 }
 
 void IRAM_ATTR Controller::Controller::post_transfer_callback(spi_transaction_t* t)
 {
 	auto self = static_cast<Controller*>(t->user);
+	portENTER_CRITICAL_ISR(&self->queueLock);
 	self->transactionDone();
+	portEXIT_CRITICAL_ISR(&self->queueLock);
 }
 
 bool Controller::startDevice(Device& dev, PinSet pinSet, uint8_t chipSelect, uint32_t clockSpeed)
@@ -130,7 +160,7 @@ bool Controller::startDevice(Device& dev, PinSet pinSet, uint8_t chipSelect, uin
 		.clock_speed_hz = int(clockSpeed),
 		.spics_io_num = chipSelect,
 		.flags = 0,
-		.queue_size = 1,
+		.queue_size = transactionSlots,
 		.pre_cb = pre_transfer_callback,
 		.post_cb = post_transfer_callback,
 	};
@@ -185,6 +215,19 @@ void Controller::stopDevice(Device& dev)
 	dev.chipSelect = 255;
 }
 
+bool Controller::setSpeed(Device& dev, uint32_t clockSpeed)
+{
+	if(dev.pinSet == PinSet::none) {
+		return false;
+	}
+
+	// Clock is fixed when device is added to the bus
+	auto pinSet = dev.pinSet;
+	auto chipSelect = dev.chipSelect;
+	stopDevice(dev);
+	return startDevice(dev, pinSet, chipSelect, clockSpeed);
+}
+
 void Controller::configChanged(Device& dev)
 {
 }
@@ -201,9 +244,20 @@ void Controller::updateConfig(Device& dev)
  * If a request is larger than that we'll need to repeat it.
  *
  * We must use the ESP32 driver to allow this stack to co-exist with native IDF components such as SPI ethernet.
- * New requests cannot be started from interrupt context, so a task is queued to do this.
- * We probably only need 2 slots in the queue to handle this (one in flight, one being prepared).
- * 
+ *
+ * Up to `transactionSlots` transactions are queued with the driver so the bus doesn't sit idle whilst
+ * the completion interrupt for the previous transaction is handled. All transactions for a request are
+ * queued ahead, followed by those for the next request provided:
+ *
+ * - It is for the same device. The driver maintains a separate queue for each device so ordering
+ *   between devices isn't guaranteed.
+ * - The preceding request cannot be re-queued, i.e. it has no completion callbacks.
+ *   Otherwise ordering for that device could be broken.
+ *
+ * Where data isn't DMA-capable it goes via bounce buffers. A transaction requiring one will wait
+ * until a buffer becomes free. Outgoing data is therefore copied whilst earlier transactions are in flight.
+ * Small inline data values are sent via the transaction descriptor itself.
+ *
  * Note: Polling mode is not suitable since our interrupt callback handler isn't invoked until `spi_device_polling_end`
  * is called.
  * 
@@ -220,18 +274,16 @@ void Controller::execute(Request& req)
 
 	if(req.maxTransactionSize == 0 || req.maxTransactionSize > hardwareBufferSize) {
 		req.maxTransactionSize = hardwareBufferSize;
-	} else {
-		req.maxTransactionSize = hardwareBufferSize - (hardwareBufferSize % req.maxTransactionSize);
 	}
 
-	// Packet transfer already in progress?
-	/*
-	   Note: Interrupt needs to be disabled whilst updating the queue.
-	   This call does a bit more than that unfortunately.
-	   Calling portDISABLE_INTERRUPTS() doesn't do the job.
-	 */
-	spi_device_acquire_bus(req.device->config.handle, portMAX_DELAY);
-	if(trans.busy) {
+	portENTER_CRITICAL(&queueLock);
+	++queueDepth;
+	if(flags.completing) {
+		// Completion callback in progress, so queue once that's finished
+		deferRequest(req);
+	} else if(parked != nullptr && joinParked(parked, &req)) {
+		// Must follow parked request for this device
+	} else if(trans.busy) {
 		// Tack new packet onto end of chain
 		auto pkt = trans.request;
 		while(pkt->next) {
@@ -241,9 +293,10 @@ void Controller::execute(Request& req)
 	} else {
 		// Not currently running, so do this one now
 		trans.request = &req;
-		startRequest();
+		trans.busy = true;
 	}
-	spi_device_release_bus(req.device->config.handle);
+	fillQueue();
+	portEXIT_CRITICAL(&queueLock);
 
 	if(!req.async) {
 		// Block and poll
@@ -251,6 +304,50 @@ void Controller::execute(Request& req)
 	}
 }
 
+/*
+ * Requests executed whilst a completion callback is running are held until it has finished.
+ * The queue lock is released during callbacks, so these may come from the callback itself
+ * or from another core. Called with queue lock held.
+ */
+void IRAM_ATTR Controller::deferRequest(Request& req)
+{
+	auto link = &deferred;
+	while(*link != nullptr) {
+		link = &(*link)->next;
+	}
+	*link = &req;
+}
+
+/*
+ * Move requests executed from completion callbacks onto the queue.
+ * Called with queue lock held.
+ */
+void IRAM_ATTR Controller::queueDeferred()
+{
+	auto tail = trans.request;
+	if(tail != nullptr) {
+		while(tail->next != nullptr) {
+			tail = tail->next;
+		}
+	}
+
+	while(deferred != nullptr) {
+		auto req = deferred;
+		deferred = req->next;
+		req->next = nullptr;
+		if(parked != nullptr && joinParked(parked, req)) {
+			continue;
+		}
+		if(tail == nullptr) {
+			trans.request = req;
+		} else {
+			tail->next = req;
+		}
+		tail = req;
+	}
+	trans.busy = (trans.request != nullptr);
+}
+
 void Controller::wait(Request& request)
 {
 	if(request.busy) {
@@ -258,6 +355,11 @@ void Controller::wait(Request& request)
 		CpuCycleTimer timer;
 #endif
 		do {
+			if(parked != nullptr) {
+				portENTER_CRITICAL(&queueLock);
+				releaseParked();
+				portEXIT_CRITICAL(&queueLock);
+			}
 		} while(request.busy);
 #ifdef HSPI_ENABLE_STATS
 		stats.waitCycles += timer.elapsedTicks();
@@ -266,34 +368,105 @@ void Controller::wait(Request& request)
 }
 
 /*
- * Start transfer of a new request (trans.request)
- * May be called from interrupt context at completion of previous request
+ * Timers can't be set from interrupt context so defer to a task
  */
-void IRAM_ATTR Controller::startRequest()
+void IRAM_ATTR Controller::queueParkTimer()
 {
-	auto& req = *trans.request;
-	auto& dev = *req.device;
+	if(!flags.parkTimerQueued) {
+		System.queueCallback([](void* param) { static_cast<Controller*>(param)->serviceParked(); }, this);
+		flags.parkTimerQueued = true;
+	}
+}
 
-	if(selectDeviceCallback) {
-		selectDeviceCallback(dev.chipSelect, true);
+/*
+ * Called from task context to re-queue parked requests which are due,
+ * then set the timer for the next one.
+ */
+void Controller::serviceParked()
+{
+	portENTER_CRITICAL(&queueLock);
+	flags.parkTimerQueued = false;
+	releaseParked();
+	bool pending = (parked != nullptr);
+	uint32_t delay = pending ? getParkedDelay(parked, system_get_time()) : 0;
+	portEXIT_CRITICAL(&queueLock);
+
+	if(pending) {
+		parkTimer.initializeUs(
+			std::max<uint32_t>(delay, 1), [](void* param) { static_cast<Controller*>(param)->serviceParked(); }, this);
+		parkTimer.startOnce();
 	}
-	dev.transferStarting(req);
+}
+
+/*
+ * Move parked requests which are due back into the queue.
+ * Called with queue lock held.
+ */
+void IRAM_ATTR Controller::releaseParked()
+{
+	trans.request = releaseRequests(trans.request, parked, system_get_time());
+	trans.busy = (trans.request != nullptr);
+	fillQueue();
+}
+
+/*
+ * Queue as many transactions as we can.
+ * Called with queue lock held.
+ */
+void IRAM_ATTR Controller::fillQueue()
+{
+	if(flags.completing) {
+		// transactionDone() refills the queue when the completion callback returns
+		return;
+	}
+
+	while(transCount < transactionSlots) {
+		if(trans.issue == nullptr) {
+			if(trans.request == nullptr) {
+				break;
+			}
+			trans.issue = trans.request;
+			startRequest();
+		} else if(!trans.pending) {
+			// All transactions for this request have been queued, can we start on the next one?
+			auto req = trans.issue;
+			auto next = req->next;
+			if(next == nullptr || next->device != req->device) {
+				break;
+			}
+			if(req->callback != nullptr || req->device->transferCallback != nullptr) {
+				break;
+			}
+			trans.issue = next;
+			startRequest();
+		}
+
+		if(!queueTransaction()) {
+			break;
+		}
+	}
+}
+
+/*
+ * Start issuing transactions for a new request (trans.issue)
+ */
+void IRAM_ATTR Controller::startRequest()
+{
+	auto& req = *trans.issue;
+	auto& dev = *req.device;
 
 	trans.addr = req.addr;
 	trans.outOffset = 0;
 	trans.inOffset = 0;
 	trans.inlen = 0;
-	trans.ioMode = dev.ioMode;
+	trans.ioMode = dev.getIoMode(req);
 	trans.bitOrder = dev.bitOrder;
-	trans.busy = true;
-
-	auto& t = esp_trans->ext;
-
-	t.base.user = this;
-	t.base.flags = SPI_TRANS_VARIABLE_CMD | SPI_TRANS_VARIABLE_ADDR | SPI_TRANS_VARIABLE_DUMMY;
+	trans.pending = true;
+	trans.first = true;
 
 	// TODO: Driver won't let us directly change DUPLEX mode on a per-transaction basis
 	// If necessary we can hack this using HAL calls
+	uint32_t flags = SPI_TRANS_VARIABLE_CMD | SPI_TRANS_VARIABLE_ADDR | SPI_TRANS_VARIABLE_DUMMY;
 	switch(trans.ioMode) {
 	case IoMode::SPI:
 	case IoMode::SPIHD:
@@ -301,58 +474,105 @@ void IRAM_ATTR Controller::startRequest()
 		break;
 	case IoMode::SDI:
 	case IoMode::DIO:
-		t.base.flags |= SPI_TRANS_MODE_DIO | SPI_TRANS_MODE_DIOQIO_ADDR;
+		flags |= SPI_TRANS_MODE_DIO | SPI_TRANS_MODE_DIOQIO_ADDR;
 		break;
 	case IoMode::DUAL:
-		t.base.flags |= SPI_TRANS_MODE_DIO;
+		flags |= SPI_TRANS_MODE_DIO;
 		break;
 	case IoMode::SQI:
 	case IoMode::QIO:
-		t.base.flags |= SPI_TRANS_MODE_QIO | SPI_TRANS_MODE_DIOQIO_ADDR;
+		flags |= SPI_TRANS_MODE_QIO | SPI_TRANS_MODE_DIOQIO_ADDR;
 		break;
 	case IoMode::QUAD:
-		t.base.flags |= SPI_TRANS_MODE_QIO;
+		flags |= SPI_TRANS_MODE_QIO;
 		break;
 	default:
 		assert(false);
 	}
+	trans.transFlags = flags;
+}
 
-	// Setup command bits
-	t.command_bits = req.cmdLen;
-	t.base.cmd = req.cmd;
+/*
+ * Queue the next transaction for the request being issued (trans.issue)
+ * Returns false if no transaction slot or bounce buffer is available.
+ */
+bool IRAM_ATTR Controller::queueTransaction()
+{
+	if(transCount >= transactionSlots) {
+		return false;
+	}
 
-	// Address bits
-	t.address_bits = req.addrLen;
-	t.base.addr = req.addr;
+	auto& req = *trans.issue;
+	auto& dev = *req.device;
+	unsigned maxlen = req.getTransactionLimit(trans.addr);
 
-	// Setup dummy bits
-	t.dummy_bits = req.dummyLen;
+	unsigned outlen = req.out.length - trans.outOffset;
+	bool outBounce{false};
+	if(outlen != 0 && req.out.isPointer) {
+		outlen = std::min(outlen, maxlen);
+		outBounce = !isDmaCapable(req.out.ptr8 + trans.outOffset);
+	} else if(req.out.isPattern()) {
+		// Pattern is generated directly into a bounce buffer
+		outlen = std::min(outlen, maxlen);
+		outBounce = true;
+	}
 
-	nextTransaction();
-}
+	unsigned inlen = req.in.length - trans.inOffset;
+	bool inBounce{false};
+	if(inlen != 0 && req.in.isPointer) {
+		inlen = std::min(inlen, maxlen);
+		// Verification requires somewhere else to put the data
+		inBounce = req.verify || !isDmaCapable(req.in.ptr8 + trans.inOffset);
+	}
 
-void IRAM_ATTR Controller::nextTransaction()
-{
-	auto& req = *trans.request;
-	auto& dev = *req.device;
+	// Claim a bounce buffer if required
+	int8_t bufIndex{-1};
+	if(outBounce || inBounce) {
+		for(unsigned i = 0; i < dmaBufferCount; ++i) {
+			if((dmaBufferBusy & (1U << i)) == 0) {
+				bufIndex = i;
+				break;
+			}
+		}
+		if(bufIndex < 0) {
+			return false;
+		}
+		dmaBufferBusy |= 1U << bufIndex;
+	}
+	auto buffer = (bufIndex < 0) ? nullptr : dmaBuffer[bufIndex];
 
-	auto& t = esp_trans->ext;
+	auto& et = esp_trans[(transHead + transCount) % transactionSlots];
+	auto& t = et.ext;
+
+	t.base.user = this;
+	t.base.flags = trans.transFlags;
+	t.base.cmd = req.cmd;
+	t.command_bits = req.cmdLen;
+	t.address_bits = req.addrLen;
+	t.dummy_bits = req.dummyLen;
+	t.base.addr = trans.addr;
 
 	// Setup outgoing data (MOSI)
-	unsigned outlen = req.out.length - trans.outOffset;
 	if(outlen != 0) {
-		if(req.out.isPointer) {
-			outlen = std::min(outlen, req.maxTransactionSize);
-			auto outptr = req.out.ptr8 + trans.outOffset;
-			if(esp_ptr_dma_capable(outptr) && IS_ALIGNED(outptr)) {
-				t.base.tx_buffer = outptr;
-			} else {
-				memcpy(dmaBuffer, outptr, outlen);
-				t.base.tx_buffer = dmaBuffer;
-			}
+		const void* src;
+		if(req.out.isPattern()) {
+			req.out.fillPattern(buffer, trans.outOffset, outlen);
+			t.base.tx_buffer = src = buffer;
+		} else if(!req.out.isPointer) {
+			t.base.flags |= SPI_TRANS_USE_TXDATA;
+			memcpy(t.base.tx_data, req.out.data, sizeof(t.base.tx_data));
+			src = req.out.data;
+		} else if(outBounce) {
+			memcpy(buffer, req.out.ptr8 + trans.outOffset, outlen);
+			t.base.tx_buffer = src = buffer;
+#ifdef HSPI_ENABLE_STATS
+			stats.bounceCopyOut += outlen;
+#endif
 		} else {
-			dmaBuffer[0] = req.out.data32;
-			t.base.tx_buffer = dmaBuffer;
+			t.base.tx_buffer = src = req.out.ptr8 + trans.outOffset;
+		}
+		if(req.calcCrc) {
+			req.crc = crc32(req.crc, src, outlen);
 		}
 		t.base.length = outlen * 8;
 		trans.outOffset += outlen;
@@ -362,30 +582,33 @@ void IRAM_ATTR Controller::nextTransaction()
 	}
 
 	// Setup incoming data (MISO)
-	unsigned inlen = req.in.length - trans.inOffset;
+	et.inOffset = trans.inOffset;
+	et.inlen = inlen;
 	if(inlen != 0) {
-		if(req.in.isPointer) {
-			inlen = std::min(inlen, req.maxTransactionSize);
-			auto inptr = req.in.ptr8 + trans.inOffset;
-			if(esp_ptr_dma_capable(inptr) && IS_ALIGNED(inptr)) {
-				t.base.rx_buffer = inptr;
-			} else {
-				t.base.rx_buffer = dmaBuffer;
-			}
+		if(!req.in.isPointer) {
+			t.base.flags |= SPI_TRANS_USE_RXDATA;
+		} else if(inBounce) {
+			t.base.rx_buffer = buffer;
 		} else {
-			t.base.rx_buffer = dmaBuffer;
+			t.base.rx_buffer = req.in.ptr8 + trans.inOffset;
 		}
-		trans.inlen = inlen;
 		t.base.rxlength = inlen * 8;
 		t.base.length = std::max(t.base.length, t.base.rxlength);
+		trans.inOffset += inlen;
 	} else {
 		t.base.rx_buffer = nullptr;
 		t.base.rxlength = 0;
 	}
 
-	// Setup address
-	t.base.addr = trans.addr;
-	trans.addr += std::max(outlen, inlen);
+	trans.addr = req.getNextAddress(trans.addr, std::max(outlen, inlen));
+
+	et.request = &req;
+	et.buffer = bufIndex;
+	et.first = trans.first;
+	et.last = (trans.outOffset >= req.out.length && trans.inOffset >= req.in.length);
+	trans.first = false;
+	trans.pending = !et.last;
+	++transCount;
 
 #ifdef HSPI_ENABLE_STATS
 	++stats.transCount;
@@ -393,60 +616,134 @@ void IRAM_ATTR Controller::nextTransaction()
 
 	// Execute now
 	spi_device_queue_trans_from_isr(dev.config.handle, &t.base);
+	return true;
 }
 
 /*
- * Read incoming data, if there is any, and start next transaction.
- * Called from interrupt context at completion of transaction.
+ * A verify request has failed, so stop issuing transactions for it.
+ * The request completes when the final transaction already in flight finishes.
  */
-void IRAM_ATTR Controller::transactionDone()
+void IRAM_ATTR Controller::verifyFailed(EspTransaction& et)
 {
-	auto& req = *trans.request;
-	auto& dev = *req.device;
+#ifdef HSPI_ENABLE_STATS
+	++stats.verifyFailed;
+#endif
 
-	if(selectDeviceCallback) {
-		selectDeviceCallback(dev.chipSelect, false);
+	auto req = et.request;
+	if(trans.issue != req || !trans.pending) {
+		// Final transaction already queued
+		return;
 	}
 
+	trans.pending = false;
+	auto last = &et;
+	for(unsigned i = 1; i < transCount; ++i) {
+		auto& t = esp_trans[(transHead + i) % transactionSlots];
+		if(t.request == req) {
+			last = &t;
+		}
+	}
+	last->last = true;
+}
+
+/*
+ * Read incoming data, if there is any, and queue further transactions.
+ * Called from interrupt context at completion of the oldest transaction in flight, with queue lock held.
+ * The lock is released whilst the completion callback runs.
+ */
+void IRAM_ATTR Controller::transactionDone()
+{
+	auto& et = esp_trans[transHead];
+	auto& req = *et.request;
+	auto& dev = *req.device;
+
 	// Read incoming data
-	if(trans.inlen != 0) {
-		if(esp_trans->ext.base.rx_buffer == dmaBuffer) {
-			if(req.in.isPointer) {
-				memcpy(req.in.ptr8 + trans.inOffset, dmaBuffer, trans.inlen);
-			} else {
-				req.in.data32 = dmaBuffer[0];
+	if(et.inlen != 0) {
+		auto& t = et.ext.base;
+		if(req.verify && req.in.isPointer) {
+			// Transactions following a mismatch are ignored
+			if(et.inOffset < req.in.length) {
+				auto buffer = static_cast<const uint32_t*>(t.rx_buffer);
+				auto pos = req.in.compare(et.inOffset, buffer, et.inlen);
+				if(pos < et.inlen) {
+					req.in.length = et.inOffset + pos;
+					verifyFailed(et);
+				}
+			}
+		} else {
+			if(!req.in.isPointer) {
+				memcpy(req.in.data, t.rx_data, sizeof(t.rx_data));
+			} else if(t.rx_buffer != req.in.ptr8 + et.inOffset) {
+				memcpy(req.in.ptr8 + et.inOffset, t.rx_buffer, et.inlen);
+#ifdef HSPI_ENABLE_STATS
+				stats.bounceCopyIn += et.inlen;
+#endif
+			}
+			if(req.calcCrc) {
+				auto data = req.in.isPointer ? req.in.ptr8 + et.inOffset : req.in.data;
+				req.crc = crc32(req.crc, data, et.inlen);
 			}
 		}
-		trans.inOffset += trans.inlen;
-		trans.inlen = 0;
 	}
 
+	// Release the slot
+	if(et.buffer >= 0) {
+		dmaBufferBusy &= ~(1U << et.buffer);
+	}
+	transHead = (transHead + 1) % transactionSlots;
+	--transCount;
+
 	// Packet complete?
-	if(trans.inOffset < req.in.length || trans.outOffset < req.out.length) {
-		// Nope, continue
-		nextTransaction();
+	if(!et.last) {
+		// Nope, keep the hardware queue topped up
+		fillQueue();
 		return;
 	}
 
-	trans.busy = false;
+	if(selectDeviceCallback) {
+		selectDeviceCallback(dev.chipSelect, false);
+	}
+
 	req.busy = false;
 #ifdef HSPI_ENABLE_STATS
 	++stats.requestCount;
 #endif
 
-	if(dev.transferComplete(req)) {
-		// Note next packet in chain and de-queue this one
-		trans.request = req.next;
-		req.next = nullptr;
+	if(trans.issue == &req) {
+		trans.issue = nullptr;
+	}
+
+	// De-queue request and release the lock whilst its callback runs
+	trans.request = req.next;
+	req.next = nullptr;
+	flags.completing = true;
+	portEXIT_CRITICAL_ISR(&queueLock);
+	bool complete = dev.transferComplete(req);
+	portENTER_CRITICAL_ISR(&queueLock);
+	flags.completing = false;
+
+	if(complete) {
+		--queueDepth;
 	} else {
-		trans.request = reQueueRequest(req.next, &req);
+		// Nothing following this request has been issued so it's safe to re-queue
 		req.busy = true;
+		if(req.requeueDelay != 0) {
+			trans.request = parkRequest(trans.request, parked, &req, system_get_time());
+			queueParkTimer();
+#ifdef HSPI_ENABLE_STATS
+			++stats.requestsParked;
+#endif
+		} else if(!joinParked(parked, &req)) {
+			trans.request = reQueueRequest(trans.request, &req);
+		}
+	}
+	trans.busy = (trans.request != nullptr);
+	if(deferred != nullptr) {
+		queueDeferred();
 	}
 
 	// Feed the hardware
-	if(trans.request != nullptr) {
-		startRequest();
-	}
+	fillQueue();
 }
 
 } // namespace HSPI
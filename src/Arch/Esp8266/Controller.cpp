@@ -31,6 +31,7 @@
 
 #include <HSPI/Controller.h>
 #include <HSPI/Device.h>
+#include <HSPI/Crc32.h>
 #include <esp_clk.h>
 #include <esp_systemapi.h>
 #include <espinc/spi_register.h>
@@ -59,6 +60,9 @@ volatile Controller::Stats Controller::stats;
 #define DPORT_SPI_INT_STATUS_SPI0 BIT4
 #define DPORT_SPI_INT_STATUS_SPI1 BIT7
 
+// Time from transaction completion to ISR entry - see 'Interrupt tests' above
+#define INTERRUPT_LATENCY_US 2
+
 // Enable the given pin as a chip select
 #define CS_ENABLE(cspin, func)                                                                                         \
 	{                                                                                                                  \
@@ -99,6 +103,56 @@ const spi_dev_t::clock_t clkDiv2{{
 	.clk_equ_sysclk = 0,
 }};
 
+/*
+ * Set register bits for data mode. These are applied for each request, using the mode captured when it was queued.
+ */
+void IRAM_ATTR setIoModeBits(IoMode ioMode, spi_dev_t::ctrl_t& ctrl, spi_dev_t::user_t& user)
+{
+	ctrl.fastrd_mode = false;
+	ctrl.fread_dio = false;
+	ctrl.fread_dual = false;
+	ctrl.fread_qio = false;
+	ctrl.fread_quad = false;
+	user.fwrite_dio = false;
+	user.fwrite_dual = false;
+	user.fwrite_qio = false;
+	user.fwrite_quad = false;
+	user.sio = false;
+	user.duplex = (ioMode == IoMode::SPI);
+	switch(ioMode) {
+	case IoMode::SPI:
+	case IoMode::SPIHD:
+		break;
+	case IoMode::SPI3WIRE:
+		user.sio = true;
+		break;
+	case IoMode::SDI:
+	case IoMode::DIO:
+		ctrl.fastrd_mode = true;
+		ctrl.fread_dio = true;
+		user.fwrite_dio = true;
+		break;
+	case IoMode::DUAL:
+		ctrl.fastrd_mode = true;
+		ctrl.fread_dual = true;
+		user.fwrite_dual = true;
+		break;
+	case IoMode::SQI:
+	case IoMode::QIO:
+		ctrl.fastrd_mode = true;
+		ctrl.fread_qio = true;
+		user.fwrite_qio = true;
+		break;
+	case IoMode::QUAD:
+		ctrl.fastrd_mode = true;
+		ctrl.fread_quad = true;
+		user.fwrite_quad = true;
+		break;
+	default:
+		assert(false);
+	}
+}
+
 /**
  * @brief Enable or disable overlap of SPI1 controller onto SPI0 pins
  * @param enable
@@ -271,6 +325,7 @@ bool Controller::begin()
 void Controller::end()
 {
 	ETS_SPI_INTR_DISABLE();
+	parkTimer.stop();
 
 	// Disable all hardware chip selects
 	SPI1.pin.cs0_dis = 1;
@@ -278,6 +333,7 @@ void Controller::end()
 	SPI1.pin.cs2_dis = 1;
 
 	flags.initialised = false;
+	flags.configValid = false;
 
 	// Check all devices have been released
 	assert(normalDevices == 0 && overlapDevices == 0);
@@ -353,6 +409,8 @@ bool Controller::startDevice(Device& dev, PinSet pinSet, uint8_t chipSelect, uin
 
 void Controller::stopDevice(Device& dev)
 {
+	flags.configValid = false;
+
 	switch(dev.pinSet) {
 	case PinSet::overlap:
 		assert(overlapDevices > 0);
@@ -400,6 +458,19 @@ void Controller::stopDevice(Device& dev)
 	dev.chipSelect = 255;
 }
 
+bool Controller::setSpeed(Device& dev, uint32_t clockSpeed)
+{
+	if(dev.pinSet == PinSet::none) {
+		return false;
+	}
+
+	spi_dev_t::clock_t reg;
+	dev.speed = calculateClock(clockSpeed, reg);
+	dev.config.reg.clock = reg.val;
+	dev.config.dirty = true;
+	return true;
+}
+
 void Controller::configChanged(Device& dev)
 {
 	dev.config.dirty = true;
@@ -453,42 +524,6 @@ void Controller::updateConfig(Device& dev)
 	reg.user.wr_byte_order = (byteOrder == MSBFIRST) ? 1 : 0;
 	reg.user.rd_byte_order = (byteOrder == MSBFIRST) ? 1 : 0;
 
-	// Data mode
-	auto ioMode = dev.getIoMode();
-	reg.user.duplex = (ioMode == IoMode::SPI);
-	switch(ioMode) {
-	case IoMode::SPI:
-	case IoMode::SPIHD:
-		break;
-	case IoMode::SPI3WIRE:
-		reg.user.sio = true;
-		break;
-	case IoMode::SDI:
-	case IoMode::DIO:
-		reg.ctrl.fastrd_mode = true;
-		reg.ctrl.fread_dio = true;
-		reg.user.fwrite_dio = true;
-		break;
-	case IoMode::DUAL:
-		reg.ctrl.fastrd_mode = true;
-		reg.ctrl.fread_dual = true;
-		reg.user.fwrite_dual = true;
-		break;
-	case IoMode::SQI:
-	case IoMode::QIO:
-		reg.ctrl.fastrd_mode = true;
-		reg.ctrl.fread_qio = true;
-		reg.user.fwrite_qio = true;
-		break;
-	case IoMode::QUAD:
-		reg.ctrl.fastrd_mode = true;
-		reg.ctrl.fread_quad = true;
-		reg.user.fwrite_quad = true;
-		break;
-	default:
-		assert(false);
-	}
-
 	// Clock phase/polarity
 	auto clockMode = uint8_t(dev.getClockMode());
 	reg.user.ck_out_edge = (clockMode & 0x01) ? 1 : 0; // CPHA
@@ -542,17 +577,51 @@ void Controller::execute(Request& req)
 		updateConfig(*dev);
 	}
 
-	// For high clock speeds don't use transaction interrupts
-	if(req.async && dev->speed >= 16000000U) {
-		//		req.task = true;
-	}
-
 	if(req.maxTransactionSize == 0 || req.maxTransactionSize > hardwareBufferSize) {
 		req.maxTransactionSize = hardwareBufferSize;
 	}
 
+	if(flags.completing) {
+		// Called from a completion callback, so queue once that's finished
+		assert(req.async);
+		deferRequest(req);
+		return;
+	}
+
+	/*
+	 * For high clock speeds transaction interrupts cost more than the transfer itself.
+	 * Compare expected time on the wire with the measured interrupt overhead.
+	 */
+	bool poll{false};
+	if(req.async && flags.adaptive) {
+		unsigned dataLength = std::max(req.out.length, req.in.length);
+		unsigned transCount = std::max(1U, (dataLength + req.maxTransactionSize - 1) / req.maxTransactionSize);
+		unsigned transLength = std::min(dataLength, req.maxTransactionSize);
+		auto clocks = getTransactionClocks(dev->getIoMode(req), req.cmdLen, req.addrLen, req.dummyLen, transLength);
+		auto cpuFreq = system_get_cpu_freq();
+		uint32_t transCycles = uint64_t(clocks) * cpuFreq * 1000000U / dev->speed;
+		uint32_t overhead = isrCycles + INTERRUPT_LATENCY_US * cpuFreq;
+		if(transCycles * transCount < overhead) {
+			poll = true;
+			req.task = true; // In case request has to be queued
+		} else {
+			req.task = (transCycles < overhead);
+		}
+	}
+
 	// Packet transfer already in progress?
 	ETS_SPI_INTR_DISABLE();
+	++queueDepth;
+	if(parked != nullptr && joinParked(parked, &req)) {
+		// Must follow parked request for this device
+		if(trans.busy && !flags.taskQueued) {
+			ETS_SPI_INTR_ENABLE();
+		}
+		if(!req.async) {
+			wait(req);
+		}
+		return;
+	}
 	if(trans.busy) {
 		// Tack new packet onto end of chain
 		auto pkt = trans.request;
@@ -561,6 +630,11 @@ void Controller::execute(Request& req)
 		}
 		pkt->next = &req;
 		if(req.async) {
+#ifdef HSPI_ENABLE_STATS
+			if(flags.adaptive) {
+				++(req.task ? stats.completeTask : stats.completeInterrupt);
+			}
+#endif
 			if(!flags.taskQueued) {
 				ETS_SPI_INTR_ENABLE();
 			}
@@ -570,7 +644,12 @@ void Controller::execute(Request& req)
 		// Not currently running, so do this one now
 		trans.request = &req;
 		startRequest();
-		if(req.async) {
+		if(req.async && !poll) {
+#ifdef HSPI_ENABLE_STATS
+			if(flags.adaptive) {
+				++(req.task ? stats.completeTask : stats.completeInterrupt);
+			}
+#endif
 			if(req.task) {
 				queueTask();
 			} else {
@@ -578,12 +657,61 @@ void Controller::execute(Request& req)
 			}
 			return;
 		}
+#ifdef HSPI_ENABLE_STATS
+		if(poll) {
+			++stats.completePoll;
+		}
+#endif
 	}
 
 	// Block and poll
 	wait(req);
 }
 
+/*
+ * Requests executed from a completion callback are held until completion processing has finished,
+ * then queued behind any request being re-queued. They always complete in interrupt context.
+ */
+void IRAM_ATTR Controller::deferRequest(Request& req)
+{
+	req.task = false;
+	++queueDepth;
+
+	auto link = &deferred;
+	while(*link != nullptr) {
+		link = &(*link)->next;
+	}
+	*link = &req;
+}
+
+/*
+ * Move requests executed from completion callbacks onto the queue
+ */
+void IRAM_ATTR Controller::queueDeferred()
+{
+	auto tail = trans.request;
+	if(tail != nullptr) {
+		while(tail->next != nullptr) {
+			tail = tail->next;
+		}
+	}
+
+	while(deferred != nullptr) {
+		auto req = deferred;
+		deferred = req->next;
+		req->next = nullptr;
+		if(parked != nullptr && joinParked(parked, req)) {
+			continue;
+		}
+		if(tail == nullptr) {
+			trans.request = req;
+		} else {
+			tail->next = req;
+		}
+		tail = req;
+	}
+}
+
 void Controller::wait(Request& request)
 {
 	if(request.busy) {
@@ -593,6 +721,9 @@ void Controller::wait(Request& request)
 		ETS_SPI_INTR_DISABLE();
 		do {
 			isr(this);
+			if(parked != nullptr) {
+				releaseParked();
+			}
 		} while(request.busy);
 #ifdef HSPI_ENABLE_STATS
 		stats.waitCycles += timer.elapsedTicks();
@@ -611,6 +742,62 @@ void IRAM_ATTR Controller::queueTask()
 	}
 }
 
+/*
+ * Timers can't be set from interrupt context so defer to a task
+ */
+void IRAM_ATTR Controller::queueParkTimer()
+{
+	if(!flags.parkTimerQueued) {
+		System.queueCallback([](void* param) { static_cast<Controller*>(param)->serviceParked(); }, this);
+		flags.parkTimerQueued = true;
+	}
+}
+
+/*
+ * Called from task context to re-queue parked requests which are due,
+ * then set the timer for the next one.
+ */
+void Controller::serviceParked()
+{
+	flags.parkTimerQueued = false;
+
+	ETS_SPI_INTR_DISABLE();
+	bool busy = trans.busy;
+	releaseParked();
+	if(busy && !flags.taskQueued) {
+		ETS_SPI_INTR_ENABLE();
+	}
+
+	if(parked == nullptr) {
+		return;
+	}
+	auto delay = getParkedDelay(parked, system_get_time());
+	parkTimer.initializeUs(
+		std::max<uint32_t>(delay, 1), [](void* param) { static_cast<Controller*>(param)->serviceParked(); }, this);
+	parkTimer.startOnce();
+}
+
+/*
+ * Move parked requests which are due back into the queue, starting the hardware if it's idle.
+ * Called with interrupts disabled.
+ */
+void IRAM_ATTR Controller::releaseParked()
+{
+	auto idle = (trans.request == nullptr);
+	trans.request = releaseRequests(trans.request, parked, system_get_time());
+	if(!idle || trans.request == nullptr) {
+		return;
+	}
+
+	trans.request = reorderRequests(trans.request);
+	startRequest();
+	if(trans.request->task) {
+		queueTask();
+	} else {
+		ETS_SPI_INTR_ENABLE();
+	}
+}
+
 /*
  * Called from task context to execute request in blocking mode.
  * This is appropriate when transaction time is very short due to relative ISR overhead.
@@ -653,58 +840,82 @@ void IRAM_ATTR Controller::startRequest()
 	auto& dev = *req.device;
 	auto& cfg = dev.config;
 
+	trans.mergeTail = mergeRequests(req);
+
 	if(selectDeviceCallback) {
 		selectDeviceCallback(dev.chipSelect, true);
 	}
 	dev.transferStarting(req);
+	if(trans.mergeTail != nullptr) {
+		auto r = &req;
+		do {
+			r = r->next;
+			dev.transferStarting(*r);
+#ifdef HSPI_ENABLE_STATS
+			++stats.requestsMerged;
+#endif
+		} while(r != trans.mergeTail);
+	}
 
 	trans.addr = req.addr;
 	trans.outOffset = 0;
 	trans.inOffset = 0;
 	trans.inlen = 0;
-	trans.ioMode = dev.getIoMode();
+	trans.ioMode = dev.getIoMode(req);
 	trans.bitOrder = dev.getBitOrder();
 	trans.busy = true;
 
-	auto pinSet = dev.pinSet;
-	if(pinSet != activePinSet) {
-		if(activePinSet == PinSet::overlap) {
-			overlapEnable(false);
-		}
+	spi_dev_t::ctrl_t ctrl{.val = cfg.reg.ctrl};
+	spi_dev_t::user_t user{.val = cfg.reg.user};
+	spi_dev_t::user1_t user1{.val = cfg.reg.user1};
+	setIoModeBits(trans.ioMode, ctrl, user);
+
+	// Registers may be left alone if previous request used the same configuration
+	if(!isActiveConfig(req)) {
+		auto pinSet = dev.pinSet;
+		if(pinSet != activePinSet) {
+			if(activePinSet == PinSet::overlap) {
+				overlapEnable(false);
+			}
 
-		// New pin set
-		if(pinSet == PinSet::overlap) {
-			overlapEnable(true);
-		}
+			// New pin set
+			if(pinSet == PinSet::overlap) {
+				overlapEnable(true);
+			}
 
-		activePinSet = pinSet;
-	}
+			activePinSet = pinSet;
+		}
 
-	// Clock
-	auto ioMux = READ_PERI_REG(PERIPHS_IO_MUX_CONF_U);
-	spi_dev_t::clock_t clk{.val = cfg.reg.clock};
-	if(clk.clk_equ_sysclk) {
-		ioMux |= SPI1_CLK_EQU_SYS_CLK;
-	} else {
-		ioMux &= ~SPI1_CLK_EQU_SYS_CLK;
-
-		// In overlap mode, SPI0 sysclock selection overrides SPI1
-		if(!flags.spi0ClockChanged && activePinSet == PinSet::overlap) {
-			if(ioMux & SPI0_CLK_EQU_SYS_CLK) {
-				SPI0.clock.val = clkDiv2.val;
-				ioMux &= ~SPI0_CLK_EQU_SYS_CLK;
-				flags.spi0ClockChanged = true;
+		// Clock
+		auto ioMux = READ_PERI_REG(PERIPHS_IO_MUX_CONF_U);
+		spi_dev_t::clock_t clk{.val = cfg.reg.clock};
+		if(clk.clk_equ_sysclk) {
+			ioMux |= SPI1_CLK_EQU_SYS_CLK;
+		} else {
+			ioMux &= ~SPI1_CLK_EQU_SYS_CLK;
+
+			// In overlap mode, SPI0 sysclock selection overrides SPI1
+			if(!flags.spi0ClockChanged && activePinSet == PinSet::overlap) {
+				if(ioMux & SPI0_CLK_EQU_SYS_CLK) {
+					SPI0.clock.val = clkDiv2.val;
+					ioMux &= ~SPI0_CLK_EQU_SYS_CLK;
+					flags.spi0ClockChanged = true;
+				}
 			}
 		}
-	}
-	WRITE_PERI_REG(PERIPHS_IO_MUX_CONF_U, ioMux);
-	SPI1.clock.val = cfg.reg.clock;
+		WRITE_PERI_REG(PERIPHS_IO_MUX_CONF_U, ioMux);
+		SPI1.clock.val = cfg.reg.clock;
 
-	SPI1.ctrl.val = cfg.reg.ctrl;
-	SPI1.pin.val = cfg.reg.pin;
+		SPI1.ctrl.val = ctrl.val;
+		SPI1.pin.val = cfg.reg.pin;
 
-	spi_dev_t::user_t user{.val = cfg.reg.user};
-	spi_dev_t::user1_t user1{.val = cfg.reg.user1};
+		activeRegs = cfg.reg;
+		activeRegs.ctrl = ctrl.val;
+		flags.configValid = true;
+#ifdef HSPI_ENABLE_STATS
+		++stats.configSwitches;
+#endif
+	}
 
 	trans.addrCmdMask = 0;
 	trans.addrShift = 0;
@@ -781,15 +992,34 @@ void IRAM_ATTR Controller::nextTransaction()
 
 	spi_dev_t::user_t user{.val = cfg.reg.user};
 	spi_dev_t::user1_t user1{.val = cfg.reg.user1};
+	unsigned maxlen = req.getTransactionLimit(trans.addr);
 
 	// Setup outgoing data (MOSI)
 	unsigned outlen = req.out.length - trans.outOffset;
 	if(outlen != 0) {
 		if(req.out.isPointer) {
-			outlen = std::min(outlen, req.maxTransactionSize);
-			memcpy((void*)SPI1.data_buf, req.out.ptr8 + trans.outOffset, ALIGNUP4(outlen));
+			outlen = std::min(outlen, maxlen);
+			auto src = req.out.ptr8 + trans.outOffset;
+			memcpy((void*)SPI1.data_buf, src, ALIGNUP4(outlen));
+			if(req.calcCrc) {
+				req.crc = crc32(req.crc, src, outlen);
+			}
+		} else if(req.out.isPattern()) {
+			outlen = std::min(outlen, maxlen);
+			if(req.calcCrc) {
+				// FIFO must be accessed as words, so generate pattern locally
+				uint32_t buffer[hardwareBufferSize / sizeof(uint32_t)];
+				req.out.fillPattern(buffer, trans.outOffset, outlen);
+				memcpy((void*)SPI1.data_buf, buffer, ALIGNUP4(outlen));
+				req.crc = crc32(req.crc, buffer, outlen);
+			} else {
+				req.out.fillPattern(SPI1.data_buf, trans.outOffset, outlen);
+			}
 		} else {
 			SPI1.data_buf[0] = req.out.data32;
+			if(req.calcCrc) {
+				req.crc = crc32(req.crc, req.out.data, outlen);
+			}
 		}
 		user1.usr_mosi_bitlen = (outlen * 8) - 1;
 		trans.outOffset += outlen;
@@ -801,7 +1031,7 @@ void IRAM_ATTR Controller::nextTransaction()
 	// Setup incoming data (MISO)
 	unsigned inlen = req.in.length - trans.inOffset;
 	if(inlen != 0) {
-		inlen = std::min(inlen, req.maxTransactionSize);
+		inlen = std::min(inlen, maxlen);
 		trans.inlen = inlen;
 		// In duplex mode data is read during MOSI stage
 		if(user.duplex) {
@@ -820,7 +1050,7 @@ void IRAM_ATTR Controller::nextTransaction()
 
 	// Setup address
 	SPI1.addr = (trans.addr << trans.addrShift) | trans.addrCmdMask;
-	trans.addr += std::max(outlen, inlen);
+	trans.addr = req.getNextAddress(trans.addr, std::max(outlen, inlen));
 
 	SPI1.user1.val = user1.val;
 	SPI1.user.val = user.val;
@@ -841,8 +1071,12 @@ void IRAM_ATTR Controller::isr(Controller* spi)
 {
 	auto status = READ_PERI_REG(DPORT_SPI_INT_STATUS_REG);
 	if(status & DPORT_SPI_INT_STATUS_SPI1) {
+		auto startTicks = esp_get_ccount();
 		SPI1.slave.trans_done = 0;
 		spi->transactionDone();
+		// Maintain running average of handling time
+		int elapsed = esp_get_ccount() - startTicks;
+		spi->isrCycles += (elapsed - int(spi->isrCycles)) / 8;
 	}
 
 	if(status & DPORT_SPI_INT_STATUS_SPI0) {
@@ -850,6 +1084,63 @@ void IRAM_ATTR Controller::isr(Controller* spi)
 	}
 }
 
+/*
+ * Determine if hardware is already configured for this request
+ */
+bool IRAM_ATTR Controller::isActiveConfig(const Request& req) const
+{
+	auto& dev = *req.device;
+	if(!flags.configValid || dev.pinSet != activePinSet) {
+		return false;
+	}
+	auto& reg = dev.config.reg;
+	if(reg.clock != activeRegs.clock || reg.pin != activeRegs.pin) {
+		return false;
+	}
+	spi_dev_t::ctrl_t ctrl{.val = reg.ctrl};
+	spi_dev_t::user_t user{.val = reg.user};
+	setIoModeBits(dev.getIoMode(req), ctrl, user);
+	return ctrl.val == activeRegs.ctrl;
+}
+
+/*
+ * If the request at the head of the queue needs a configuration switch, look for one within the
+ * reorder window which doesn't and start that instead. A request is only eligible if there
+ * are no requests ahead of it for the same device.
+ */
+Request* IRAM_ATTR Controller::reorderRequests(Request* head)
+{
+	if(reorderWindow == 0 || head->next == nullptr || isActiveConfig(*head) ||
+	   bypassCount >= reorderWindow) {
+		bypassCount = 0;
+		return head;
+	}
+
+	auto prev = head;
+	for(unsigned i = 0; i < reorderWindow && prev->next != nullptr; ++i) {
+		auto req = prev->next;
+		if(isActiveConfig(*req)) {
+			auto r = head;
+			while(r != req && r->device != req->device) {
+				r = r->next;
+			}
+			if(r == req) {
+				prev->next = req->next;
+				req->next = head;
+				++bypassCount;
+#ifdef HSPI_ENABLE_STATS
+				++stats.switchesAvoided;
+#endif
+				return req;
+			}
+		}
+		prev = req;
+	}
+
+	bypassCount = 0;
+	return head;
+}
+
 /*
  * Read incoming data, if there is any, and start next transaction.
  * Called from interrupt context at completion of transaction.
@@ -871,7 +1162,18 @@ void IRAM_ATTR Controller::transactionDone()
 
 	// Read incoming data
 	if(trans.inlen != 0) {
-		if(req.in.isPointer) {
+		if(req.verify && req.in.isPointer) {
+			auto pos = req.in.compare(trans.inOffset, SPI1.data_buf, trans.inlen);
+			if(pos < trans.inlen) {
+				// Mismatch: stop here and report position via length
+				req.in.length = trans.inOffset + pos;
+				trans.inOffset = req.in.length;
+				trans.inlen = 0;
+#ifdef HSPI_ENABLE_STATS
+				++stats.verifyFailed;
+#endif
+			}
+		} else if(req.in.isPointer) {
 			auto dst = req.in.ptr8 + trans.inOffset;
 			if(IS_ALIGNED(dst) && IS_ALIGNED(trans.inlen)) {
 				memcpy(dst, (const void*)SPI1.data_buf, trans.inlen);
@@ -881,8 +1183,14 @@ void IRAM_ATTR Controller::transactionDone()
 				memcpy(buffer, (const void*)SPI1.data_buf, len);
 				memcpy(dst, buffer, trans.inlen);
 			}
+			if(req.calcCrc) {
+				req.crc = crc32(req.crc, dst, trans.inlen);
+			}
 		} else {
 			req.in.data32 = SPI1.data_buf[0];
+			if(req.calcCrc) {
+				req.crc = crc32(req.crc, req.in.data, trans.inlen);
+			}
 		}
 		trans.inOffset += trans.inlen;
 		trans.inlen = 0;
@@ -897,22 +1205,50 @@ void IRAM_ATTR Controller::transactionDone()
 
 	TESTPIN1_LOW();
 	trans.busy = false;
-	req.busy = false;
+
+	// De-queue this request and any merged with it
+	auto tail = &req;
+	if(trans.mergeTail != nullptr) {
+		tail = trans.mergeTail;
+		splitRequests(req, *tail);
+		trans.mergeTail = nullptr;
+	}
+	trans.request = tail->next;
+	tail->next = nullptr;
+
+	// Complete requests individually
+	flags.completing = true;
+	for(auto r = &req; r != nullptr;) {
+		auto next = r->next;
+		r->next = nullptr;
+		r->busy = false;
 #ifdef HSPI_ENABLE_STATS
-	++stats.requestCount;
+		++stats.requestCount;
 #endif
-
-	// Note next packet in chain and de-queue this one
-	trans.request = req.next;
-	req.next = nullptr;
-
-	if(!dev.transferComplete(req)) {
-		trans.request = reQueueRequest(trans.request, &req);
-		req.busy = true;
+		if(dev.transferComplete(*r)) {
+			--queueDepth;
+		} else {
+			r->busy = true;
+			if(r->requeueDelay != 0) {
+				trans.request = parkRequest(trans.request, parked, r, system_get_time());
+				queueParkTimer();
+#ifdef HSPI_ENABLE_STATS
+				++stats.requestsParked;
+#endif
+			} else if(!joinParked(parked, r)) {
+				trans.request = reQueueRequest(trans.request, r);
+			}
+		}
+		r = next;
+	}
+	flags.completing = false;
+	if(deferred != nullptr) {
+		queueDeferred();
 	}
 
 	// Feed the hardware
 	if(trans.request != nullptr) {
+		trans.request = reorderRequests(trans.request);
 		if(trans.request->task) {
 			ETS_SPI_INTR_DISABLE();
 			startRequest();
@@ -921,10 +1257,14 @@ void IRAM_ATTR Controller::transactionDone()
 			startRequest();
 			ETS_SPI_INTR_ENABLE();
 		}
-	} else if(flags.spi0ClockChanged) {
-		// All transfers have completed, set SPI0 clock back to full speed
-		SET_PERI_REG_MASK(PERIPHS_IO_MUX_CONF_U, SPI0_CLK_EQU_SYS_CLK);
-		flags.spi0ClockChanged = false;
+	} else {
+		// Hardware may be used by other code whilst we're idle
+		flags.configValid = false;
+		if(flags.spi0ClockChanged) {
+			// All transfers have completed, set SPI0 clock back to full speed
+			SET_PERI_REG_MASK(PERIPHS_IO_MUX_CONF_U, SPI0_CLK_EQU_SYS_CLK);
+			flags.spi0ClockChanged = false;
+		}
 	}
 }
 
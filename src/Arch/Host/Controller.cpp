@@ -13,8 +13,11 @@
 #include <hostlib/threads.h>
 #include <HSPI/Controller.h>
 #include <HSPI/Device.h>
+#include <HSPI/Crc32.h>
 #include <debug_progmem.h>
 #include <Platform/Timers.h>
+#include <Platform/System.h>
+#include <esp_systemapi.h>
 #include <cassert>
 
 #define ETS_SPI_INTR_ATTACH(func, arg) asyncThread.attach(func, arg)
@@ -127,7 +130,9 @@ void printRequest(Request& req)
 {
 	debug_d("req .cmd = 0x%04x, %u, .out = %p, %u; .in = %p, %u; .callback = %p, %p; async = %u", req.cmd, req.cmdLen,
 			req.out.get(), req.out.length, req.in.get(), req.in.length, req.callback, req.param, unsigned(req.async));
-	if(req.out.length > 0) {
+	if(req.out.isPattern()) {
+		debug_hex(DBG, "FILL", req.out.get(), req.out.patternLength, -1, 32);
+	} else if(req.out.length > 0) {
 		debug_hex(DBG, "OUT", req.out.get(), std::min(req.out.length, uint16_t(32)), -1, 32);
 	}
 }
@@ -155,6 +160,7 @@ bool Controller::begin()
 void Controller::end()
 {
 	ETS_SPI_INTR_DISABLE();
+	parkTimer.stop();
 	flags.initialised = false;
 }
 
@@ -182,6 +188,16 @@ void Controller::stopDevice(Device& dev)
 	dev.chipSelect = 255;
 }
 
+bool Controller::setSpeed(Device& dev, uint32_t clockSpeed)
+{
+	if(dev.pinSet == PinSet::none) {
+		return false;
+	}
+
+	dev.speed = dev.config.reg.clock = clockSpeed;
+	return true;
+}
+
 void Controller::configChanged(Device& dev)
 {
 	dev.config.dirty = true;
@@ -203,6 +219,26 @@ void Controller::execute(Request& req)
 
 	// Packet transfer already in progress?
 	ETS_SPI_INTR_DISABLE();
+	++queueDepth;
+	if(flags.completing) {
+		/*
+		 * With the async thread stopped this can only be a call from a completion callback.
+		 * Queue once that's finished: transactionDone() restarts the thread when it feeds the hardware.
+		 */
+		assert(req.async);
+		deferRequest(req);
+		return;
+	}
+	if(parked != nullptr && joinParked(parked, &req)) {
+		// Must follow parked request for this device
+		if(trans.busy) {
+			ETS_SPI_INTR_ENABLE();
+		}
+		if(!req.async) {
+			wait(req);
+		}
+		return;
+	}
 	if(trans.busy) {
 		// Tack new packet onto end of chain
 		auto pkt = trans.request;
@@ -224,6 +260,48 @@ void Controller::execute(Request& req)
 	wait(req);
 }
 
+/*
+ * Requests executed from a completion callback are held until completion processing has finished
+ */
+void Controller::deferRequest(Request& req)
+{
+	req.next = nullptr;
+
+	auto link = &deferred;
+	while(*link != nullptr) {
+		link = &(*link)->next;
+	}
+	*link = &req;
+}
+
+/*
+ * Move requests executed from completion callbacks onto the queue
+ */
+void Controller::queueDeferred()
+{
+	auto tail = trans.request;
+	if(tail != nullptr) {
+		while(tail->next != nullptr) {
+			tail = tail->next;
+		}
+	}
+
+	while(deferred != nullptr) {
+		auto req = deferred;
+		deferred = req->next;
+		req->next = nullptr;
+		if(parked != nullptr && joinParked(parked, req)) {
+			continue;
+		}
+		if(tail == nullptr) {
+			trans.request = req;
+		} else {
+			tail->next = req;
+		}
+		tail = req;
+	}
+}
+
 void Controller::wait(Request& request)
 {
 	if(!request.busy) {
@@ -234,22 +312,77 @@ void Controller::wait(Request& request)
 #endif
 	ETS_SPI_INTR_DISABLE();
 	do {
-		isr(this);
+		if(parked != nullptr) {
+			releaseParked();
+		}
+		if(trans.request != nullptr) {
+			isr(this);
+		}
 	} while(request.busy);
 #ifdef HSPI_ENABLE_STATS
 	stats.waitCycles += timer.elapsedTicks();
 #endif
 }
 
+void Controller::queueParkTimer()
+{
+	if(!flags.parkTimerQueued) {
+		System.queueCallback([](void* param) { static_cast<Controller*>(param)->serviceParked(); }, this);
+		flags.parkTimerQueued = true;
+	}
+}
+
+void Controller::serviceParked()
+{
+	flags.parkTimerQueued = false;
+
+	ETS_SPI_INTR_DISABLE();
+	bool busy = trans.busy;
+	releaseParked();
+	if(busy) {
+		ETS_SPI_INTR_ENABLE();
+	}
+
+	if(parked == nullptr) {
+		return;
+	}
+	auto delay = getParkedDelay(parked, system_get_time());
+	parkTimer.initializeUs(
+		std::max<uint32_t>(delay, 1), [](void* param) { static_cast<Controller*>(param)->serviceParked(); }, this);
+	parkTimer.startOnce();
+}
+
+void Controller::releaseParked()
+{
+	auto idle = (trans.request == nullptr);
+	trans.request = releaseRequests(trans.request, parked, system_get_time());
+	if(idle && trans.request != nullptr) {
+		startRequest();
+		ETS_SPI_INTR_ENABLE();
+	}
+}
+
 void Controller::startRequest()
 {
 	trans.busy = true;
 	auto& req = *trans.request;
 	auto& dev = *req.device;
+	trans.mergeTail = mergeRequests(req);
+
 	if(selectDeviceCallback) {
 		selectDeviceCallback(dev.chipSelect, true);
 	}
 	dev.transferStarting(req);
+	if(trans.mergeTail != nullptr) {
+		auto r = &req;
+		do {
+			r = r->next;
+			dev.transferStarting(*r);
+#ifdef HSPI_ENABLE_STATS
+			++stats.requestsMerged;
+#endif
+		} while(r != trans.mergeTail);
+	}
 }
 
 void Controller::isr(Controller* spi)
@@ -274,27 +407,65 @@ void Controller::transactionDone()
 #endif
 
 	printRequest(req);
+	if(req.calcCrc) {
+		if(req.out.isPattern()) {
+			uint32_t buffer[SPI_BUFSIZE / sizeof(uint32_t)];
+			for(unsigned offset = 0; offset < req.out.length; offset += SPI_BUFSIZE) {
+				unsigned len = std::min(req.out.length - offset, SPI_BUFSIZE);
+				req.out.fillPattern(buffer, offset, len);
+				req.crc = crc32(req.crc, buffer, len);
+			}
+		} else {
+			req.crc = crc32(req.crc, req.out.get(), req.out.length);
+		}
+		if(!req.verify) {
+			req.crc = crc32(req.crc, req.in.get(), req.in.length);
+		}
+	}
 	if(selectDeviceCallback) {
 		selectDeviceCallback(dev.chipSelect, false);
 	}
 
 	trans.busy = false;
-	req.busy = false;
+
+	// De-queue this request and any merged with it
+	auto tail = &req;
+	if(trans.mergeTail != nullptr) {
+		tail = trans.mergeTail;
+		splitRequests(req, *tail);
+		trans.mergeTail = nullptr;
+	}
+	trans.request = tail->next;
+	tail->next = nullptr;
+
+	// Complete requests individually
+	flags.completing = true;
+	for(auto r = &req; r != nullptr;) {
+		auto next = r->next;
+		r->next = nullptr;
+		r->busy = false;
 #ifdef HSPI_ENABLE_STATS
-	++stats.requestCount;
+		++stats.requestCount;
 #endif
-
-	// Note next packet in chain and de-queue this one
-	trans.request = req.next;
-	req.next = nullptr;
-
+		if(dev.transferComplete(*r)) {
+			--queueDepth;
+		} else {
+			r->busy = true;
+			if(r->requeueDelay != 0) {
+				trans.request = parkRequest(trans.request, parked, r, system_get_time());
+				queueParkTimer();
 #ifdef HSPI_ENABLE_STATS
-	++stats.requestCount;
+				++stats.requestsParked;
 #endif
-
-	if(!dev.transferComplete(req)) {
-		trans.request = reQueueRequest(trans.request, &req);
-		req.busy = true;
+			} else if(!joinParked(parked, r)) {
+				trans.request = reQueueRequest(trans.request, r);
+			}
+		}
+		r = next;
+	}
+	flags.completing = false;
+	if(deferred != nullptr) {
+		queueDeferred();
 	}
 
 	// Feed the hardware
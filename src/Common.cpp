@@ -40,4 +40,12 @@ const IoModeInfo getIoModeInfo(IoMode mode)
 	return ioModeInfo[unsigned(mode)];
 }
 
+uint32_t getTransactionClocks(IoMode mode, uint8_t cmdLen, uint8_t addrLen, uint8_t dummyLen, size_t dataLength)
+{
+	auto info = getIoModeInfo(mode);
+	auto bitsToClocks = [](uint32_t bits, uint8_t bitsPerClock) { return (bits + bitsPerClock - 1) / bitsPerClock; };
+	return bitsToClocks(cmdLen, info.clockBits) + bitsToClocks(addrLen, info.addrressBits) + dummyLen +
+		   bitsToClocks(dataLength * 8, info.dataBits);
+}
+
 } // namespace HSPI
@@ -0,0 +1,172 @@
+/**
+ * CompositeMemory.cpp
+ *
+ * Copyright 2021 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the HardwareSPI Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#include "include/HSPI/CompositeMemory.h"
+#include <Platform/System.h>
+
+namespace HSPI
+{
+bool CompositeMemory::addMember(MemoryDevice& device)
+{
+	if(active || memberCount >= maxMembers) {
+		return false;
+	}
+
+	auto& m = members[memberCount++];
+	m.owner = this;
+	m.device = &device;
+	m.bytesRead = 0;
+	m.bytesWritten = 0;
+	m.done = true;
+	return true;
+}
+
+bool CompositeMemory::read(uint32_t address, void* buffer, size_t len, InterruptDelegate callback)
+{
+	return start(address, static_cast<uint8_t*>(buffer), len, false, callback);
+}
+
+bool CompositeMemory::write(uint32_t address, const void* data, size_t len, InterruptDelegate callback)
+{
+	return start(address, static_cast<uint8_t*>(const_cast<void*>(data)), len, true, callback);
+}
+
+bool CompositeMemory::start(uint32_t address, uint8_t* buffer, size_t len, bool isWrite, InterruptDelegate callback)
+{
+	if(active) {
+		debug_e("[HSPI] Composite memory busy");
+		return false;
+	}
+
+	if(memberCount == 0 || len == 0 || address + len > getSize()) {
+		debug_e("[HSPI] Composite memory range invalid: 0x%08x, %u", address, len);
+		return false;
+	}
+
+	op.address = address;
+	op.buffer = buffer;
+	op.length = len;
+	op.isWrite = isWrite;
+	this->callback = callback;
+	active = true;
+
+	startOperation();
+
+	// Get initial segments before starting anything so completion isn't signalled prematurely
+	Segment segments[maxMembers];
+	for(unsigned i = 0; i < memberCount; ++i) {
+		auto& m = members[i];
+		m.done = !getSegment(m, segments[i]);
+	}
+
+	for(unsigned i = 0; i < memberCount; ++i) {
+		auto& m = members[i];
+		if(m.done) {
+			continue;
+		}
+		auto& seg = segments[i];
+		if(isWrite) {
+			m.device->prepareWrite(m.req, seg.address, seg.buffer, seg.length);
+			m.bytesWritten += seg.length;
+		} else {
+			m.device->prepareRead(m.req, seg.address, seg.buffer, seg.length);
+			m.bytesRead += seg.length;
+		}
+		m.req.setAsync(requestComplete, &m);
+		m.device->execute(m.req);
+	}
+
+	return true;
+}
+
+void CompositeMemory::wait()
+{
+	/*
+	 * A request's busy flag is clear whilst its callback sets up the next segment,
+	 * so on a dual-core system one pass could return part-way through the operation.
+	 */
+	while(active) {
+		for(unsigned i = 0; i < memberCount; ++i) {
+			auto& m = members[i];
+			m.device->wait(m.req);
+		}
+		complete();
+	}
+}
+
+void IRAM_ATTR CompositeMemory::setSegment(Member& member, const Segment& segment)
+{
+	auto& req = member.req;
+	req.addr = segment.address;
+	if(op.isWrite) {
+		req.out.set(segment.buffer, segment.length);
+		member.bytesWritten += segment.length;
+	} else {
+		req.in.set(segment.buffer, segment.length);
+		member.bytesRead += segment.length;
+	}
+}
+
+void CompositeMemory::complete()
+{
+	taskQueued = false;
+
+	if(!active) {
+		return;
+	}
+
+	for(unsigned i = 0; i < memberCount; ++i) {
+		auto& m = members[i];
+		if(!m.done || m.req.busy) {
+			return;
+		}
+	}
+
+	active = false;
+
+	if(callback) {
+		auto cb = callback;
+		callback = nullptr;
+		cb();
+	}
+}
+
+bool IRAM_ATTR CompositeMemory::requestComplete(Request& req)
+{
+	auto& member = *static_cast<Member*>(req.param);
+	auto self = member.owner;
+
+	Segment segment;
+	if(self->getSegment(member, segment)) {
+		self->setSegment(member, segment);
+		// Re-queue for next segment
+		return false;
+	}
+
+	member.done = true;
+
+	if(!self->taskQueued) {
+		self->taskQueued = true;
+		System.queueCallback([](void* param) { static_cast<CompositeMemory*>(param)->complete(); }, self);
+	}
+
+	return true;
+}
+
+} // namespace HSPI
@@ -0,0 +1,80 @@
+/**
+ * Crc32.cpp
+ *
+ * Copyright 2021 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the HardwareSPI Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#include "include/HSPI/Crc32.h"
+#include <esp_attr.h>
+#include <cstring>
+
+namespace HSPI
+{
+namespace
+{
+constexpr uint32_t polynomial{0xEDB88320}; // Reversed 0x04C11DB7
+
+/*
+ * table[0] is the standard byte-wise table.
+ * table[n][i] gives the CRC contribution of byte i followed by n zero bytes.
+ */
+struct Tables {
+	uint32_t table[4][256];
+
+	constexpr Tables() : table{}
+	{
+		for(unsigned i = 0; i < 256; ++i) {
+			uint32_t crc = i;
+			for(unsigned j = 0; j < 8; ++j) {
+				crc = (crc >> 1) ^ ((crc & 1) ? polynomial : 0);
+			}
+			table[0][i] = crc;
+		}
+		for(unsigned i = 0; i < 256; ++i) {
+			for(unsigned n = 1; n < 4; ++n) {
+				auto prev = table[n - 1][i];
+				table[n][i] = (prev >> 8) ^ table[0][prev & 0xff];
+			}
+		}
+	}
+};
+
+// Non-const so tables are placed in RAM, not flash, as they're used from interrupt context
+Tables tables;
+
+} // namespace
+
+uint32_t IRAM_ATTR crc32(uint32_t crc, const void* data, size_t length)
+{
+	auto& t = tables.table;
+	auto p = static_cast<const uint8_t*>(data);
+	crc = ~crc;
+
+	for(; length >= 4; length -= 4, p += 4) {
+		uint32_t word;
+		memcpy(&word, p, 4);
+		crc ^= word;
+		crc = t[3][crc & 0xff] ^ t[2][(crc >> 8) & 0xff] ^ t[1][(crc >> 16) & 0xff] ^ t[0][crc >> 24];
+	}
+
+	for(; length != 0; --length, ++p) {
+		crc = (crc >> 8) ^ t[0][(crc ^ *p) & 0xff];
+	}
+
+	return ~crc;
+}
+
+} // namespace HSPI
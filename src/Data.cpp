@@ -0,0 +1,76 @@
+/**
+ * Data.cpp
+ *
+ * Copyright 2021 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the HardwareSPI Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#include "include/HSPI/Data.h"
+#include <esp_attr.h>
+#include <cstring>
+
+namespace HSPI
+{
+void IRAM_ATTR Data::fillPattern(volatile uint32_t* buffer, unsigned offset, unsigned length) const
+{
+	// Treat anything not set up by setPattern() as a 4-byte pattern
+	unsigned len = (patternLength != 0) ? patternLength : 4;
+	// A 3-byte pattern repeats every 3 words, others every word
+	unsigned period = (len == 3) ? 3 : 1;
+	uint32_t words[3];
+	for(unsigned w = 0; w < period; ++w) {
+		uint32_t value{0};
+		for(unsigned i = 0; i < 4; ++i) {
+			value |= uint32_t(data[(offset + w * 4 + i) % len]) << (i * 8);
+		}
+		words[w] = value;
+	}
+
+	unsigned count = (length + 3) / 4;
+	unsigned w{0};
+	for(unsigned i = 0; i < count; ++i) {
+		buffer[i] = words[w];
+		if(++w == period) {
+			w = 0;
+		}
+	}
+}
+
+unsigned IRAM_ATTR Data::compare(unsigned offset, const volatile uint32_t* buffer, unsigned length) const
+{
+	auto expected = ptr8 + offset;
+
+	// Compare whole words first
+	unsigned i{0};
+	for(; i + 4 <= length; i += 4) {
+		uint32_t word;
+		memcpy(&word, expected + i, 4);
+		if(buffer[i / 4] != word) {
+			break;
+		}
+	}
+
+	// Locate mismatch within word, or check trailing bytes
+	for(; i < length; ++i) {
+		uint8_t c = buffer[i / 4] >> ((i % 4) * 8);
+		if(c != expected[i]) {
+			return i;
+		}
+	}
+
+	return length;
+}
+
+} // namespace HSPI
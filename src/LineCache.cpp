@@ -0,0 +1,157 @@
+/**
+ * LineCache.cpp
+ *
+ * Copyright 2021 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the HardwareSPI Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#include "include/HSPI/RAM/LineCache.h"
+#include <algorithm>
+#include <cstring>
+
+namespace HSPI
+{
+namespace RAM
+{
+bool LineCache::begin()
+{
+	if(buffer != nullptr) {
+		return true;
+	}
+
+	if(lineCount == 0 || (lineCount & (lineCount - 1)) != 0) {
+		return false;
+	}
+
+	buffer = new uint8_t[lineCount * lineSize];
+	tags = new uint32_t[lineCount];
+	if(buffer == nullptr || tags == nullptr) {
+		end();
+		return false;
+	}
+
+	invalidate();
+	return true;
+}
+
+void LineCache::end()
+{
+	waitFill();
+	delete[] tags;
+	tags = nullptr;
+	delete[] buffer;
+	buffer = nullptr;
+}
+
+void LineCache::invalidate()
+{
+	waitFill();
+	std::fill_n(tags, lineCount, noLine);
+}
+
+void LineCache::waitFill()
+{
+	for(auto& req : fillReq) {
+		device.wait(req);
+	}
+	fillIndex = noIndex;
+}
+
+const uint8_t* LineCache::getLine(uint32_t address, size_t count)
+{
+	auto line = address / lineSize;
+	auto index = line & (lineCount - 1);
+	auto data = &buffer[index * lineSize];
+	if(index == fillIndex) {
+		waitFill();
+	}
+	if(tags[index] == line) {
+		++stats.hits;
+		return data;
+	}
+
+	++stats.misses;
+
+	// Previous fill must finish before its requests are re-used
+	waitFill();
+
+	// Bytes needed by the caller go first, so we can return as soon as they've arrived
+	auto offset = address % lineSize;
+	device.read(address, &data[offset], count);
+	tags[index] = line;
+
+	// Rest of line is filled in the background using plain reads, so the device stays in linear mode
+	auto lineAddress = line * lineSize;
+	auto end = offset + count;
+	if(offset != 0) {
+		device.read(fillReq[0], lineAddress, data, offset);
+		fillIndex = index;
+	}
+	if(end < lineSize) {
+		device.read(fillReq[1], lineAddress + end, &data[end], lineSize - end);
+		fillIndex = index;
+	}
+
+	return data;
+}
+
+bool LineCache::read(uint32_t address, void* buffer, size_t len)
+{
+	if(this->buffer == nullptr || address + len > device.getSize()) {
+		return false;
+	}
+
+	auto dst = static_cast<uint8_t*>(buffer);
+	while(len != 0) {
+		auto offset = address % lineSize;
+		auto count = std::min(len, size_t(lineSize - offset));
+		memcpy(dst, getLine(address, count) + offset, count);
+		dst += count;
+		address += count;
+		len -= count;
+	}
+
+	return true;
+}
+
+bool LineCache::write(uint32_t address, const void* data, size_t len)
+{
+	if(buffer == nullptr || address + len > device.getSize()) {
+		return false;
+	}
+
+	// A pending fill may still be reading old content into its line
+	waitFill();
+	device.write(address, data, len);
+
+	auto src = static_cast<const uint8_t*>(data);
+	while(len != 0) {
+		auto line = address / lineSize;
+		auto offset = address % lineSize;
+		auto count = std::min(len, size_t(lineSize - offset));
+		auto index = line & (lineCount - 1);
+		if(tags[index] == line) {
+			memcpy(&buffer[index * lineSize + offset], src, count);
+		}
+		src += count;
+		address += count;
+		len -= count;
+	}
+
+	return true;
+}
+
+} // namespace RAM
+} // namespace HSPI
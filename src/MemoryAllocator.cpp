@@ -0,0 +1,326 @@
+/**
+ * MemoryAllocator.cpp
+ *
+ * Copyright 2021 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the HardwareSPI Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#include "include/HSPI/MemoryAllocator.h"
+#include <Platform/Timers.h>
+
+namespace HSPI
+{
+namespace
+{
+__forceinline unsigned msb(uint32_t value)
+{
+	return 31 - __builtin_clz(value);
+}
+
+__forceinline unsigned lowestBit(uint32_t value)
+{
+	return __builtin_ctz(value);
+}
+
+} // namespace
+
+MemoryAllocator::MemoryAllocator(MemoryDevice& device, uint16_t maxBlocks, uint16_t alignment)
+	: device(device), maxBlocks(std::min(maxBlocks, uint16_t(none - 1)))
+{
+	if(alignment > 1) {
+		alignShift = msb(alignment);
+	}
+}
+
+bool MemoryAllocator::begin(uint32_t start, uint32_t size)
+{
+	auto deviceSize = device.getSize();
+	if(size == 0 && start < deviceSize) {
+		size = deviceSize - start;
+	}
+	// Round region inwards to allocation granularity
+	auto mask = (1U << alignShift) - 1;
+	auto end = (start + size) & ~mask;
+	start = (start + mask) & ~mask;
+	if(maxBlocks == 0 || end <= start || end > deviceSize) {
+		debug_e("[HSPI] Allocator region invalid");
+		return false;
+	}
+
+	if(blocks == nullptr) {
+		blocks = new Block[maxBlocks];
+		if(blocks == nullptr) {
+			return false;
+		}
+	}
+
+	flBitmap = 0;
+	for(unsigned fl = 0; fl < flCount; ++fl) {
+		slBitmap[fl] = 0;
+		for(unsigned sl = 0; sl < slCount; ++sl) {
+			freeLists[fl][sl] = none;
+		}
+	}
+
+	// Chain all descriptors together as spares
+	for(unsigned i = 0; i < maxBlocks; ++i) {
+		blocks[i].inUse = false;
+		blocks[i].nextFree = (i + 1 < maxBlocks) ? i + 1 : none;
+	}
+	spare = 0;
+
+	// Start with a single free block
+	totalSize = end - start;
+	auto index = newDescriptor();
+	auto& block = blocks[index];
+	block.address = start;
+	block.size = totalSize;
+	block.prevPhys = none;
+	block.nextPhys = none;
+	insertFree(index);
+
+	counters = {};
+	return true;
+}
+
+/*
+ * Get free list indices for a block size.
+ * Sizes are in units of allocation granularity. First level is the power of 2,
+ * second level divides that range linearly into `slCount` lists.
+ */
+void MemoryAllocator::mapping(uint32_t size, unsigned& fl, unsigned& sl) const
+{
+	auto units = size >> alignShift;
+	if(units < slCount) {
+		fl = 0;
+		sl = units;
+	} else {
+		auto f = msb(units);
+		fl = f - slLog2 + 1;
+		sl = (units >> (f - slLog2)) - slCount;
+	}
+}
+
+/*
+ * Find a free block of at least `size` bytes.
+ * Size is rounded up to the next list boundary so any block in the selected list is suitable.
+ */
+uint16_t MemoryAllocator::findFree(uint32_t size)
+{
+	auto units = size >> alignShift;
+	if(units >= slCount) {
+		auto round = (1U << (msb(units) - slLog2)) - 1;
+		if(units + round < units) {
+			return none;
+		}
+		size += round << alignShift;
+	}
+
+	unsigned fl, sl;
+	mapping(size, fl, sl);
+	if(fl >= flCount) {
+		return none;
+	}
+
+	uint32_t slMap = slBitmap[fl] & (~0U << sl);
+	if(slMap == 0) {
+		uint32_t flMap = (fl + 1 < 32) ? flBitmap & (~0U << (fl + 1)) : 0;
+		if(flMap == 0) {
+			return none;
+		}
+		fl = lowestBit(flMap);
+		slMap = slBitmap[fl];
+	}
+	sl = lowestBit(slMap);
+
+	return freeLists[fl][sl];
+}
+
+void MemoryAllocator::insertFree(uint16_t index)
+{
+	auto& block = blocks[index];
+	unsigned fl, sl;
+	mapping(block.size, fl, sl);
+	auto& head = freeLists[fl][sl];
+	block.isFree = true;
+	block.prevFree = none;
+	block.nextFree = head;
+	if(head != none) {
+		blocks[head].prevFree = index;
+	}
+	head = index;
+	flBitmap |= 1U << fl;
+	slBitmap[fl] |= 1U << sl;
+}
+
+void MemoryAllocator::removeFree(uint16_t index)
+{
+	auto& block = blocks[index];
+	if(block.prevFree != none) {
+		blocks[block.prevFree].nextFree = block.nextFree;
+	}
+	if(block.nextFree != none) {
+		blocks[block.nextFree].prevFree = block.prevFree;
+	}
+
+	unsigned fl, sl;
+	mapping(block.size, fl, sl);
+	auto& head = freeLists[fl][sl];
+	if(head == index) {
+		head = block.nextFree;
+		if(head == none) {
+			slBitmap[fl] &= ~(1U << sl);
+			if(slBitmap[fl] == 0) {
+				flBitmap &= ~(1U << fl);
+			}
+		}
+	}
+	block.isFree = false;
+}
+
+uint16_t MemoryAllocator::newDescriptor()
+{
+	auto index = spare;
+	if(index != none) {
+		spare = blocks[index].nextFree;
+		blocks[index].inUse = true;
+	}
+	return index;
+}
+
+void MemoryAllocator::releaseDescriptor(uint16_t index)
+{
+	auto& block = blocks[index];
+	block.inUse = false;
+	block.nextFree = spare;
+	spare = index;
+}
+
+/*
+ * Absorb physically following block `next` into `index`
+ */
+void MemoryAllocator::merge(uint16_t index, uint16_t next)
+{
+	auto& block = blocks[index];
+	auto& nextBlock = blocks[next];
+	block.size += nextBlock.size;
+	block.nextPhys = nextBlock.nextPhys;
+	if(block.nextPhys != none) {
+		blocks[block.nextPhys].prevPhys = index;
+	}
+	releaseDescriptor(next);
+}
+
+MemoryAllocator::Handle MemoryAllocator::allocate(size_t size)
+{
+	CpuCycleTimer timer;
+
+	auto mask = (1U << alignShift) - 1;
+	if(blocks == nullptr || size == 0 || size > totalSize) {
+		++counters.failCount;
+		return invalidHandle;
+	}
+	size = (size + mask) & ~mask;
+
+	auto index = findFree(size);
+	if(index == none) {
+		++counters.failCount;
+		return invalidHandle;
+	}
+
+	removeFree(index);
+
+	// Split off the remainder if there's a descriptor available for it
+	auto& block = blocks[index];
+	if(block.size > size) {
+		auto rem = newDescriptor();
+		if(rem != none) {
+			auto& remBlock = blocks[rem];
+			remBlock.address = block.address + size;
+			remBlock.size = block.size - size;
+			remBlock.prevPhys = index;
+			remBlock.nextPhys = block.nextPhys;
+			if(block.nextPhys != none) {
+				blocks[block.nextPhys].prevPhys = rem;
+			}
+			block.nextPhys = rem;
+			block.size = size;
+			insertFree(rem);
+		}
+	}
+
+	++counters.allocCount;
+	auto cycles = timer.elapsedTicks();
+	counters.totalAllocCycles += cycles;
+	counters.maxAllocCycles = std::max(counters.maxAllocCycles, cycles);
+
+	return index;
+}
+
+void MemoryAllocator::free(Handle handle)
+{
+	if(handle >= maxBlocks || !blocks[handle].inUse || blocks[handle].isFree) {
+		debug_e("[HSPI] Invalid handle %u", handle);
+		return;
+	}
+
+	CpuCycleTimer timer;
+
+	auto index = handle;
+	auto next = blocks[index].nextPhys;
+	if(next != none && blocks[next].isFree) {
+		removeFree(next);
+		merge(index, next);
+	}
+	auto prev = blocks[index].prevPhys;
+	if(prev != none && blocks[prev].isFree) {
+		removeFree(prev);
+		merge(prev, index);
+		index = prev;
+	}
+	insertFree(index);
+
+	++counters.freeCount;
+	counters.maxFreeCycles = std::max(counters.maxFreeCycles, uint32_t(timer.elapsedTicks()));
+}
+
+MemoryAllocator::Stats MemoryAllocator::getStats() const
+{
+	Stats stats{};
+	stats.totalSize = totalSize;
+	stats.allocCount = counters.allocCount;
+	stats.failCount = counters.failCount;
+	stats.freeCount = counters.freeCount;
+	stats.maxAllocCycles = counters.maxAllocCycles;
+	stats.totalAllocCycles = counters.totalAllocCycles;
+	stats.maxFreeCycles = counters.maxFreeCycles;
+
+	for(unsigned i = 0; i < maxBlocks && blocks != nullptr; ++i) {
+		auto& block = blocks[i];
+		if(!block.inUse) {
+			++stats.spareDescriptors;
+		} else if(block.isFree) {
+			++stats.freeBlocks;
+			stats.largestFree = std::max(stats.largestFree, block.size);
+		} else {
+			++stats.usedBlocks;
+			stats.usedSize += block.size;
+		}
+	}
+
+	return stats;
+}
+
+} // namespace HSPI
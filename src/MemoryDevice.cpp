@@ -0,0 +1,229 @@
+/**
+ * MemoryDevice.cpp
+ *
+ * Copyright 2021 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the HardwareSPI Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#include "include/HSPI/MemoryDevice.h"
+#include <esp_systemapi.h>
+
+namespace HSPI
+{
+bool MemoryDevice::startRect(RectRequest& req, bool isWrite, uint32_t address, uint32_t deviceStride, void* buffer,
+							 uint16_t bufferStride, uint16_t rowLength, uint16_t rows, Callback callback, void* param)
+{
+	wait(req);
+
+	if(rowLength > 0x7fff) {
+		debug_e("[HSPI] Rect rowLength too long: %u", rowLength);
+		return false;
+	}
+
+	if(rowLength == 0 || rows == 0) {
+		return false;
+	}
+
+	req.buffer = static_cast<uint8_t*>(buffer);
+	req.deviceStride = deviceStride;
+	req.bufferStride = bufferStride;
+	req.rowLength = rowLength;
+	req.isWrite = isWrite;
+	req.rectCallback = callback;
+
+	// Rows with no gaps can be transferred together
+	req.rowsPerSegment = 1;
+	if(deviceStride == rowLength && bufferStride == rowLength) {
+		req.rowsPerSegment = std::max(1U, std::min(unsigned(rows), 0x7fffU / rowLength));
+	}
+	req.segmentRows = std::min(rows, req.rowsPerSegment);
+	req.rowsRemaining = rows - req.segmentRows;
+
+	auto len = req.segmentRows * rowLength;
+	if(isWrite) {
+		prepareWrite(req, address, req.buffer, len);
+	} else {
+		prepareRead(req, address, req.buffer, len);
+	}
+	req.setAsync(rectComplete, param);
+	execute(req);
+	return true;
+}
+
+bool IRAM_ATTR MemoryDevice::rectComplete(Request& request)
+{
+	auto& req = static_cast<RectRequest&>(request);
+
+	if(req.rowsRemaining == 0) {
+		return (req.rectCallback == nullptr) || req.rectCallback(req);
+	}
+
+	// Advance to next segment and re-queue
+	req.addr += req.segmentRows * req.deviceStride;
+	req.buffer += req.segmentRows * req.bufferStride;
+	req.segmentRows = std::min(req.rowsRemaining, req.rowsPerSegment);
+	req.rowsRemaining -= req.segmentRows;
+	auto len = req.segmentRows * req.rowLength;
+	if(req.isWrite) {
+		req.out.set(req.buffer, len);
+	} else {
+		req.in.set(req.buffer, len);
+	}
+	return false;
+}
+
+/*
+ * Write a pseudo-random pattern and read it back, then repeat with the inverse so every bit is exercised both ways.
+ */
+bool MemoryDevice::checkPattern(const ProbeSettings& settings, uint8_t* buffer, uint32_t seed)
+{
+	for(unsigned pass = 0; pass < 2; ++pass) {
+		uint32_t value = seed;
+		for(unsigned i = 0; i < settings.length; ++i) {
+			value = value * 1103515245 + 12345;
+			buffer[i] = (value >> 16) ^ (pass ? 0xff : 0);
+		}
+		write(settings.address, buffer, settings.length);
+		if(verify(settings.address, buffer, settings.length) >= 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Mode switch commands may still be queued, and must go out at the speed they were issued at
+ */
+bool MemoryDevice::changeSpeed(uint32_t clockSpeed)
+{
+	waitCommands();
+	return setSpeed(clockSpeed);
+}
+
+bool MemoryDevice::probe(ProbeResult& result, const ProbeSettings& settings)
+{
+	if(settings.length == 0 || settings.address + settings.length > getSize() || settings.minSpeed == 0) {
+		debug_e("[HSPI] probe(): Invalid settings");
+		return false;
+	}
+
+	auto buffer = new uint8_t[settings.length];
+	if(buffer == nullptr) {
+		return false;
+	}
+
+	const uint32_t safeSpeed = getSpeed();
+	const IoMode safeMode = getIoMode();
+	ProbeResult best{};
+
+	auto modes = getSupportedIoModes();
+	for(unsigned m = 0; m <= unsigned(IoMode::SQI); ++m) {
+		auto mode = IoMode(m);
+		if(!modes[mode]) {
+			continue;
+		}
+
+		// Change mode at a speed known to work
+		changeSpeed(safeSpeed);
+		if(!setIoMode(mode)) {
+			continue;
+		}
+
+		uint32_t lastSpeed{0};
+		for(unsigned div = 1; settings.maxSpeed / div >= settings.minSpeed; ++div) {
+			changeSpeed(settings.maxSpeed / div);
+			auto speed = getSpeed();
+			if(speed == lastSpeed) {
+				// Same clock divisor as previous attempt
+				continue;
+			}
+			lastSpeed = speed;
+
+			if(!checkPattern(settings, buffer, speed ^ unsigned(mode))) {
+				continue;
+			}
+
+			auto startTime = system_get_time();
+			unsigned i;
+			for(i = 0; i < settings.iterations; ++i) {
+				if(verify(settings.address, buffer, settings.length) >= 0) {
+					break;
+				}
+			}
+			if(i < settings.iterations) {
+				// Marginal, try a slower speed
+				continue;
+			}
+			auto elapsed = std::max(system_get_time() - startTime, 1U);
+			auto bytesPerSecond = uint32_t(uint64_t(settings.length) * settings.iterations * 1000000 / elapsed);
+			debug_d("[HSPI] probe(): Mode %u, %u Hz, %u bytes/s", unsigned(mode), speed, bytesPerSecond);
+			if(bytesPerSecond > best.bytesPerSecond) {
+				best = ProbeResult{uint32_t(getSize()), speed, bytesPerSecond, mode};
+			}
+			break;
+		}
+	}
+
+	delete[] buffer;
+
+	// Leave device in best mode, or as we found it
+	changeSpeed(safeSpeed);
+	if(best.bytesPerSecond == 0) {
+		debug_e("[HSPI] probe(): No working setting found");
+		setIoMode(safeMode);
+		return false;
+	}
+
+	setIoMode(best.ioMode);
+	changeSpeed(best.clockSpeed);
+	result = best;
+	return true;
+}
+
+bool MemoryDevice::applyProbeResult(const ProbeResult& result)
+{
+	if(result.deviceSize != getSize() || result.clockSpeed == 0 || !isSupported(result.ioMode)) {
+		return false;
+	}
+
+	if(!setIoMode(result.ioMode)) {
+		return false;
+	}
+	return changeSpeed(result.clockSpeed);
+}
+
+MemoryDevice::TuneResult MemoryDevice::tune(ProbeResult& cache, const ProbeSettings& settings)
+{
+	const uint32_t safeSpeed = getSpeed();
+	const IoMode safeMode = getIoMode();
+
+	if(applyProbeResult(cache)) {
+		auto buffer = new uint8_t[settings.length];
+		if(buffer != nullptr) {
+			bool ok = checkPattern(settings, buffer, cache.clockSpeed);
+			delete[] buffer;
+			if(ok) {
+				return TuneResult::unchanged;
+			}
+		}
+		debug_w("[HSPI] tune(): Cached setting failed, re-probing");
+		changeSpeed(safeSpeed);
+		setIoMode(safeMode);
+	}
+
+	return probe(cache, settings) ? TuneResult::updated : TuneResult::failed;
+}
+
+} // namespace HSPI
@@ -0,0 +1,338 @@
+/**
+ * MemoryLog.cpp
+ *
+ * Copyright 2021 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the HardwareSPI Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#include "include/HSPI/MemoryLog.h"
+#include <Platform/System.h>
+#include <cstring>
+
+namespace HSPI
+{
+bool MemoryLog::begin()
+{
+	if(bufferSize <= sizeof(Header) || baseAddress + size > device.getSize()) {
+		debug_e("[HSPI] MemoryLog parameters invalid");
+		return false;
+	}
+
+	if(buffer == nullptr) {
+		// Group staging buffers followed by scan buffer
+		buffer = new uint8_t[(groupCount + 1) * bufferSize];
+		if(buffer == nullptr) {
+			return false;
+		}
+	}
+
+	for(unsigned i = 0; i < groupCount; ++i) {
+		auto& group = groups[i];
+		device.wait(group.req);
+		group.data = &buffer[i * bufferSize];
+		group.length = 0;
+		group.lastSequence = 0;
+		group.writing = false;
+	}
+	device.wait(scanReq);
+	scanState = ScanState::idle;
+
+	groupIndex = commitIndex = 0;
+	endOffset = 0;
+	nextSequence = 1;
+	committedSequence = 0;
+	return true;
+}
+
+void MemoryLog::end()
+{
+	if(buffer == nullptr) {
+		return;
+	}
+
+	for(auto& group : groups) {
+		device.wait(group.req);
+	}
+	device.wait(scanReq);
+	scanState = ScanState::idle;
+
+	delete[] buffer;
+	buffer = nullptr;
+}
+
+uint32_t MemoryLog::append(const void* data, uint16_t length)
+{
+	size_t recordSize = sizeof(Header) + length;
+	if(buffer == nullptr || recordSize > bufferSize) {
+		++stats.appendFailures;
+		return 0;
+	}
+
+	auto group = &groups[groupIndex];
+	if(group->length + recordSize > bufferSize) {
+		if(!startWrite()) {
+			++stats.appendFailures;
+			return 0;
+		}
+		group = &groups[groupIndex];
+	}
+
+	if(endOffset + group->length + recordSize > size) {
+		++stats.appendFailures;
+		return 0;
+	}
+
+	Header hdr{length, uint16_t(~length)};
+	memcpy(&group->data[group->length], &hdr, sizeof(hdr));
+	memcpy(&group->data[group->length + sizeof(hdr)], data, length);
+	group->length += recordSize;
+	group->lastSequence = nextSequence;
+	++stats.records;
+
+	// Group is committed when task runs
+	queueTask();
+
+	return nextSequence++;
+}
+
+void MemoryLog::flush()
+{
+	if(buffer == nullptr) {
+		return;
+	}
+
+	while(isScanning()) {
+		device.wait(scanReq);
+		task();
+	}
+
+	for(unsigned i = 0; i < groupCount; ++i) {
+		startWrite();
+		device.wait(groups[commitIndex].req);
+		checkCommits();
+	}
+}
+
+/*
+ * Start writing current group and switch to the next one.
+ * Returns false if the next group is still being written, or compaction is in progress.
+ */
+bool MemoryLog::startWrite()
+{
+	auto& group = groups[groupIndex];
+	if(group.length == 0) {
+		return true;
+	}
+
+	if(compactDelegate) {
+		return false;
+	}
+
+	auto& next = groups[(groupIndex + 1) % groupCount];
+	if(next.writing) {
+		return false;
+	}
+
+	group.writing = true;
+	device.write(group.req, baseAddress + endOffset, group.data, group.length, requestComplete, this);
+	endOffset += group.length;
+	++stats.groups;
+	stats.bytesWritten += group.length;
+	groupIndex = (groupIndex + 1) % groupCount;
+	return true;
+}
+
+/*
+ * Report completed groups in the order they were written
+ */
+void MemoryLog::checkCommits()
+{
+	for(;;) {
+		auto& group = groups[commitIndex];
+		if(!group.writing || group.req.busy) {
+			break;
+		}
+		group.writing = false;
+		group.length = 0;
+		committedSequence = group.lastSequence;
+		commitIndex = (commitIndex + 1) % groupCount;
+		if(commitDelegate) {
+			commitDelegate(committedSequence);
+		}
+	}
+}
+
+void MemoryLog::queueTask()
+{
+	if(!taskQueued) {
+		taskQueued = true;
+		System.queueCallback([](void* param) { static_cast<MemoryLog*>(param)->task(); }, this);
+	}
+}
+
+void MemoryLog::task()
+{
+	taskQueued = false;
+
+	if(buffer == nullptr) {
+		return;
+	}
+
+	checkCommits();
+
+	if(scanState != ScanState::idle && !scanReq.busy) {
+		if(scanState == ScanState::reading) {
+			processChunk();
+		} else {
+			readChunk();
+		}
+	}
+
+	startWrite();
+}
+
+bool MemoryLog::replay(ReplayDelegate recordCallback, InterruptDelegate doneCallback)
+{
+	if(buffer == nullptr || isScanning()) {
+		return false;
+	}
+
+	replayDelegate = recordCallback;
+	this->doneCallback = doneCallback;
+	return startScan();
+}
+
+bool MemoryLog::compact(CompactDelegate filter, InterruptDelegate doneCallback)
+{
+	if(buffer == nullptr || isScanning() || !filter) {
+		return false;
+	}
+
+	compactDelegate = filter;
+	this->doneCallback = doneCallback;
+	return startScan();
+}
+
+bool MemoryLog::startScan()
+{
+	// Groups already issued are written before any scan reads as requests complete in order
+	scanOffset = 0;
+	scanEnd = endOffset;
+	compactOffset = 0;
+	readChunk();
+	return true;
+}
+
+void MemoryLog::readChunk()
+{
+	scanLength = std::min(uint32_t(bufferSize), scanEnd - scanOffset);
+	if(scanLength < sizeof(Header)) {
+		scanComplete();
+		return;
+	}
+
+	scanState = ScanState::reading;
+	device.read(scanReq, baseAddress + scanOffset, &buffer[groupCount * bufferSize], scanLength, requestComplete,
+				this);
+}
+
+/*
+ * Handle all complete records in the scan buffer.
+ * For compaction, records are kept by moving them to the start of the buffer and writing them back.
+ */
+void MemoryLog::processChunk()
+{
+	auto data = &buffer[groupCount * bufferSize];
+	unsigned pos{0};
+	unsigned kept{0};
+	while(pos + sizeof(Header) <= scanLength) {
+		Header hdr;
+		memcpy(&hdr, &data[pos], sizeof(hdr));
+		if(hdr.check != uint16_t(~hdr.length)) {
+			debug_e("[HSPI] Log corrupt at 0x%08x", scanOffset + pos);
+			scanEnd = scanOffset + pos;
+			break;
+		}
+		unsigned recordSize = sizeof(Header) + hdr.length;
+		if(pos + recordSize > scanLength) {
+			break;
+		}
+		auto record = &data[pos + sizeof(Header)];
+		if(!compactDelegate) {
+			replayDelegate(record, hdr.length);
+		} else if(compactDelegate(record, hdr.length)) {
+			if(kept != pos) {
+				memmove(&data[kept], &data[pos], recordSize);
+			}
+			kept += recordSize;
+		} else {
+			++stats.recordsDropped;
+		}
+		pos += recordSize;
+	}
+
+	if(pos == 0) {
+		// Truncated or corrupt record
+		scanEnd = scanOffset;
+	}
+
+	auto srcOffset = scanOffset;
+	scanOffset += pos;
+
+	if(compactDelegate) {
+		auto dstOffset = compactOffset;
+		compactOffset += kept;
+		// Nothing to write until first record is dropped
+		if(kept != 0 && (dstOffset != srcOffset || kept != pos)) {
+			scanState = ScanState::writing;
+			device.write(scanReq, baseAddress + dstOffset, data, kept, requestComplete, this);
+			return;
+		}
+	}
+
+	readChunk();
+}
+
+void MemoryLog::scanComplete()
+{
+	if(compactDelegate) {
+		// No groups have been written since compaction started
+		endOffset = compactOffset;
+		compactDelegate = nullptr;
+	}
+	replayDelegate = nullptr;
+	scanState = ScanState::idle;
+
+	auto callback = doneCallback;
+	doneCallback = nullptr;
+	if(callback) {
+		callback();
+	}
+
+	// Write any records appended during compaction
+	queueTask();
+}
+
+bool IRAM_ATTR MemoryLog::requestComplete(Request& req)
+{
+	auto self = static_cast<MemoryLog*>(req.param);
+	if(!self->taskQueued) {
+		self->taskQueued = true;
+		System.queueCallback([](void* param) { static_cast<MemoryLog*>(param)->task(); }, self);
+	}
+	return true;
+}
+
+} // namespace HSPI
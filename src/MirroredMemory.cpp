@@ -0,0 +1,104 @@
+/**
+ * MirroredMemory.cpp
+ *
+ * Copyright 2021 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the HardwareSPI Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#include "include/HSPI/MirroredMemory.h"
+
+namespace HSPI
+{
+size_t MirroredMemory::getSize() const
+{
+	if(memberCount == 0) {
+		return 0;
+	}
+
+	size_t size = members[0].device->getSize();
+	for(unsigned i = 1; i < memberCount; ++i) {
+		size = std::min(size, members[i].device->getSize());
+	}
+
+	return size;
+}
+
+void MirroredMemory::startOperation()
+{
+	uint32_t endAddress = op.address + op.length;
+
+	if(op.isWrite) {
+		for(unsigned i = 0; i < memberCount; ++i) {
+			members[i].position = op.address;
+			members[i].limit = endAddress;
+		}
+		return;
+	}
+
+	// Nothing to read unless allocated below
+	for(unsigned i = 0; i < memberCount; ++i) {
+		members[i].position = members[i].limit = endAddress;
+	}
+
+	if(op.length < splitThreshold) {
+		// Pick least-loaded member, rotating between those with equal load
+		unsigned best = nextRead % memberCount;
+		for(unsigned n = 1; n < memberCount; ++n) {
+			auto i = (nextRead + n) % memberCount;
+			if(getQueueDepth(i) < getQueueDepth(best)) {
+				best = i;
+			}
+		}
+		members[best].position = op.address;
+		nextRead = best + 1;
+		return;
+	}
+
+	// Share is inversely proportional to (1 + queue depth)
+	uint16_t weights[maxMembers];
+	unsigned totalWeight{0};
+	for(unsigned i = 0; i < memberCount; ++i) {
+		weights[i] = 0x100 / (1 + getQueueDepth(i));
+		totalWeight += weights[i];
+	}
+
+	uint32_t address = op.address;
+	for(unsigned i = 0; i < memberCount; ++i) {
+		// Proportion of what remains, so the final member takes the rest
+		uint32_t share = uint64_t(endAddress - address) * weights[i] / totalWeight;
+		totalWeight -= weights[i];
+		auto& m = members[i];
+		m.position = address;
+		address += share;
+		m.limit = address;
+	}
+}
+
+bool IRAM_ATTR MirroredMemory::getSegment(Member& member, Segment& segment)
+{
+	if(member.position >= member.limit) {
+		return false;
+	}
+
+	auto len = std::min(member.limit - member.position, uint32_t(maxSegmentSize));
+	segment.address = member.position;
+	segment.buffer = op.buffer + (member.position - op.address);
+	segment.length = len;
+
+	member.position += len;
+	return true;
+}
+
+} // namespace HSPI
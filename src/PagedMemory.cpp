@@ -0,0 +1,297 @@
+/**
+ * PagedMemory.cpp
+ *
+ * Copyright 2021 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the HardwareSPI Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#include "include/HSPI/PagedMemory.h"
+#include <cstring>
+
+namespace HSPI
+{
+bool PagedMemory::begin()
+{
+	if(slots != nullptr) {
+		return true;
+	}
+
+	if(cacheSize == 0 || pageSize == 0) {
+		return false;
+	}
+
+	buffer = new uint8_t[cacheSize * pageSize];
+	slots = new Slot[cacheSize];
+	if(buffer == nullptr || slots == nullptr) {
+		end();
+		return false;
+	}
+
+	for(unsigned i = 0; i < cacheSize; ++i) {
+		auto& slot = slots[i];
+		slot.data = &buffer[i * pageSize];
+		slot.page = noPage;
+		slot.lastUse = 0;
+		slot.pinCount = 0;
+		slot.dirty = false;
+		slot.prefetched = false;
+	}
+
+	return true;
+}
+
+void PagedMemory::end()
+{
+	if(slots != nullptr) {
+		flush(true);
+	}
+
+	delete[] slots;
+	slots = nullptr;
+	delete[] buffer;
+	buffer = nullptr;
+}
+
+int PagedMemory::findSlot(uint32_t page) const
+{
+	for(unsigned i = 0; i < cacheSize; ++i) {
+		if(slots[i].page == page) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/*
+ * Find an unpinned slot to re-use: an empty one if available, otherwise the least-recently used
+ * clean page. If `mayWrite` is set and there are no clean pages, all dirty pages are written back.
+ */
+int PagedMemory::getVictim(bool mayWrite)
+{
+	int clean{-1};
+	int dirty{-1};
+	for(unsigned i = 0; i < cacheSize; ++i) {
+		auto& slot = slots[i];
+		if(slot.pinCount != 0) {
+			continue;
+		}
+		if(slot.page == noPage) {
+			return i;
+		}
+		int& victim = slot.dirty ? dirty : clean;
+		if(victim < 0 || slot.lastUse < slots[victim].lastUse) {
+			victim = i;
+		}
+	}
+
+	if(clean < 0 && dirty >= 0 && mayWrite) {
+		// Batch write-back so future evictions find clean pages
+		flush(false);
+		clean = dirty;
+	}
+
+	if(clean >= 0) {
+		auto& slot = slots[clean];
+		device.wait(slot.req);
+		if(slot.page != noPage) {
+			++stats.evictions;
+		}
+		slot.page = noPage;
+		slot.prefetched = false;
+	}
+
+	return clean;
+}
+
+void PagedMemory::load(Slot& slot, uint32_t page)
+{
+	device.wait(slot.req);
+	slot.page = page;
+	slot.dirty = false;
+	device.read(slot.req, getAddress(page), slot.data, pageSize);
+}
+
+void PagedMemory::writeBack(Slot& slot)
+{
+	device.wait(slot.req);
+	device.write(slot.req, getAddress(slot.page), slot.data, pageSize);
+	slot.dirty = false;
+	++stats.writeBacks;
+}
+
+uint8_t* PagedMemory::pin(uint32_t page, bool forWrite)
+{
+	if(slots == nullptr || page >= getPageCount()) {
+		return nullptr;
+	}
+
+	auto i = findSlot(page);
+	if(i >= 0) {
+		++stats.hits;
+		if(slots[i].prefetched) {
+			++stats.prefetchHits;
+			slots[i].prefetched = false;
+		}
+	} else {
+		i = getVictim(true);
+		if(i < 0) {
+			debug_e("[HSPI] All pages pinned");
+			return nullptr;
+		}
+		++stats.misses;
+		load(slots[i], page);
+	}
+
+	auto& slot = slots[i];
+	// Wait for read (or a write-back with a pinned page) to complete
+	device.wait(slot.req);
+	++slot.pinCount;
+	slot.lastUse = ++useCounter;
+	if(forWrite) {
+		slot.dirty = true;
+	}
+	return slot.data;
+}
+
+/*
+ * Pin a page which is to be completely overwritten, so no need to read it
+ */
+uint8_t* PagedMemory::pinEmpty(uint32_t page)
+{
+	if(slots == nullptr || page >= getPageCount()) {
+		return nullptr;
+	}
+
+	auto i = getVictim(true);
+	if(i < 0) {
+		debug_e("[HSPI] All pages pinned");
+		return nullptr;
+	}
+
+	auto& slot = slots[i];
+	slot.page = page;
+	slot.dirty = true;
+	slot.pinCount = 1;
+	slot.lastUse = ++useCounter;
+	return slot.data;
+}
+
+void PagedMemory::unpin(uint32_t page, bool dirty)
+{
+	auto i = findSlot(page);
+	if(i < 0 || slots[i].pinCount == 0) {
+		debug_e("[HSPI] Page #%u not pinned", page);
+		return;
+	}
+
+	auto& slot = slots[i];
+	--slot.pinCount;
+	if(dirty) {
+		slot.dirty = true;
+	}
+}
+
+bool PagedMemory::prefetch(uint32_t page)
+{
+	if(slots == nullptr || page >= getPageCount()) {
+		return false;
+	}
+
+	if(findSlot(page) >= 0) {
+		return true;
+	}
+
+	auto i = getVictim(false);
+	if(i < 0) {
+		return false;
+	}
+
+	auto& slot = slots[i];
+	load(slot, page);
+	slot.prefetched = true;
+	slot.lastUse = ++useCounter;
+	++stats.prefetches;
+	return true;
+}
+
+void PagedMemory::flush(bool wait)
+{
+	if(slots == nullptr) {
+		return;
+	}
+
+	// Queue all writes first, then wait
+	for(unsigned i = 0; i < cacheSize; ++i) {
+		auto& slot = slots[i];
+		// Pinned pages may still be modified, so leave them dirty until released
+		if(slot.dirty && slot.page != noPage && slot.pinCount == 0) {
+			writeBack(slot);
+		}
+	}
+
+	if(wait) {
+		for(unsigned i = 0; i < cacheSize; ++i) {
+			device.wait(slots[i].req);
+		}
+	}
+}
+
+bool PagedMemory::read(uint32_t address, void* buffer, size_t len)
+{
+	auto dst = static_cast<uint8_t*>(buffer);
+	while(len != 0) {
+		auto page = address / pageSize;
+		auto offset = address % pageSize;
+		auto count = std::min(len, size_t(pageSize - offset));
+		auto data = pin(page);
+		if(data == nullptr) {
+			return false;
+		}
+		memcpy(dst, data + offset, count);
+		unpin(page);
+		address += count;
+		dst += count;
+		len -= count;
+	}
+	return true;
+}
+
+bool PagedMemory::write(uint32_t address, const void* data, size_t len)
+{
+	auto src = static_cast<const uint8_t*>(data);
+	while(len != 0) {
+		auto page = address / pageSize;
+		auto offset = address % pageSize;
+		auto count = std::min(len, size_t(pageSize - offset));
+		// No need to read page from device if it's being completely overwritten
+		uint8_t* pageData;
+		if(count == pageSize && findSlot(page) < 0) {
+			pageData = pinEmpty(page);
+		} else {
+			pageData = pin(page, true);
+		}
+		if(pageData == nullptr) {
+			return false;
+		}
+		memcpy(pageData + offset, src, count);
+		unpin(page, true);
+		address += count;
+		src += count;
+		len -= count;
+	}
+	return true;
+}
+
+} // namespace HSPI
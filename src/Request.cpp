@@ -22,6 +22,7 @@
 
 #include "include/HSPI/Request.h"
 #include <esp_attr.h>
+#include <algorithm>
 
 namespace HSPI
 {
@@ -64,4 +65,183 @@ Request* IRAM_ATTR reQueueRequest(Request* head, Request* request)
 	return otherQueue.next;
 }
 
+Request* IRAM_ATTR parkRequest(Request* head, Request*& parked, Request* request, uint32_t now)
+{
+	request->parked = true;
+	request->dueTime = now + request->requeueDelay;
+
+	// Split off queued requests for the same device, as for reQueueRequest()
+	Request otherQueue;
+	Request* otherTail = &otherQueue;
+	Request* thisTail = request;
+
+	auto cur = head;
+	while(cur != nullptr) {
+		if(cur->device == request->device) {
+			thisTail->next = cur;
+			thisTail = cur;
+		} else {
+			otherTail->next = cur;
+			otherTail = cur;
+		}
+		cur = cur->next;
+	}
+	otherTail->next = nullptr;
+
+	// Parked list is a sequence of groups, each starting with a request which has `parked` set
+	thisTail->next = parked;
+	parked = request;
+
+	return otherQueue.next;
+}
+
+bool IRAM_ATTR joinParked(Request*& parked, Request* request)
+{
+	auto cur = parked;
+	while(cur != nullptr && cur->device != request->device) {
+		cur = cur->next;
+	}
+	if(cur == nullptr) {
+		return false;
+	}
+
+	// Append to end of group
+	while(cur->next != nullptr && !cur->next->parked) {
+		cur = cur->next;
+	}
+	request->next = cur->next;
+	cur->next = request;
+	return true;
+}
+
+Request* IRAM_ATTR releaseRequests(Request* head, Request*& parked, uint32_t now)
+{
+	auto tail = head;
+	if(tail != nullptr) {
+		while(tail->next != nullptr) {
+			tail = tail->next;
+		}
+	}
+
+	auto link = &parked;
+	while(*link != nullptr) {
+		auto group = *link;
+		auto last = group;
+		while(last->next != nullptr && !last->next->parked) {
+			last = last->next;
+		}
+		if(int32_t(now - group->dueTime) < 0) {
+			link = &last->next;
+			continue;
+		}
+
+		// Move group to end of queue
+		*link = last->next;
+		last->next = nullptr;
+		group->parked = false;
+		if(tail == nullptr) {
+			head = group;
+		} else {
+			tail->next = group;
+		}
+		tail = last;
+	}
+
+	return head;
+}
+
+uint32_t IRAM_ATTR getParkedDelay(const Request* parked, uint32_t now)
+{
+	int32_t delay = parked->dueTime - now;
+	for(auto req = parked->next; req != nullptr; req = req->next) {
+		if(req->parked) {
+			delay = std::min(delay, int32_t(req->dueTime - now));
+		}
+	}
+	return std::max<int32_t>(delay, 0);
+}
+
+namespace
+{
+Data& IRAM_ATTR getMergeData(Request& req)
+{
+	return (req.out.length != 0) ? req.out : req.in;
+}
+
+bool IRAM_ATTR isContiguous(const Data& head, const Data& data, uint16_t length)
+{
+	return head.isPointer && data.isPointer && data.length != 0 && data.ptr8 == head.ptr8 + length &&
+		   length + data.length <= 0x7fff;
+}
+
+/*
+ * Determine if `req` can be appended to a burst started by `head`, with `length` bytes so far
+ */
+bool IRAM_ATTR canMerge(const Request& head, const Request& req, uint16_t length)
+{
+	if(!req.merge || req.calcCrc || req.cmd != head.cmd || req.cmdLen != head.cmdLen || req.addrLen != head.addrLen ||
+	   req.dummyLen != head.dummyLen || req.addr != head.addr + length || req.overrideIoMode != head.overrideIoMode ||
+	   req.ioMode != head.ioMode) {
+		return false;
+	}
+
+	if(head.in.length == 0) {
+		return req.in.length == 0 && isContiguous(head.out, req.out, length);
+	}
+	if(head.out.length == 0) {
+		return req.out.length == 0 && isContiguous(head.in, req.in, length);
+	}
+	return false;
+}
+
+} // namespace
+
+Request* IRAM_ATTR mergeRequests(Request& request)
+{
+	if(!request.merge || request.calcCrc) {
+		return nullptr;
+	}
+
+	auto& data = getMergeData(request);
+	if(!data.isPointer || (request.out.length != 0 && request.in.length != 0)) {
+		return nullptr;
+	}
+
+	Request* tail = &request;
+	for(;;) {
+		// Find next request for this device
+		auto prev = tail;
+		auto req = tail->next;
+		while(req != nullptr && req->device != request.device) {
+			prev = req;
+			req = req->next;
+		}
+		if(req == nullptr || !canMerge(request, *req, data.length)) {
+			break;
+		}
+
+		// Move it to follow tail
+		if(prev != tail) {
+			prev->next = req->next;
+			req->next = tail->next;
+			tail->next = req;
+		}
+
+		data.length += getMergeData(*req).length;
+		tail = req;
+	}
+
+	return (tail == &request) ? nullptr : tail;
+}
+
+void IRAM_ATTR splitRequests(Request& request, Request& tail)
+{
+	auto& data = getMergeData(request);
+	auto req = &request;
+	do {
+		req = req->next;
+		data.length -= getMergeData(*req).length;
+	} while(req != &tail);
+}
+
 } // namespace HSPI
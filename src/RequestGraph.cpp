@@ -0,0 +1,194 @@
+/**
+ * RequestGraph.cpp
+ *
+ * Copyright 2021 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the HardwareSPI Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#include "include/HSPI/RequestGraph.h"
+#include <Platform/System.h>
+
+namespace HSPI
+{
+RequestGraph::~RequestGraph()
+{
+	wait();
+
+	if(taskQueued) {
+		// Task still holds the token, so it frees it
+		token->graph = nullptr;
+	} else {
+		delete token;
+	}
+}
+
+int RequestGraph::add(Device& device, Request& request, Mask dependsOn)
+{
+	if(isBusy()) {
+		debug_e("[HSPI] Graph busy");
+		return -1;
+	}
+
+	if(nodeCount >= maxNodes) {
+		debug_e("[HSPI] Graph full");
+		return -1;
+	}
+
+	// Dependencies must be on earlier nodes, so there can be no cycles
+	if((dependsOn >> nodeCount) != 0) {
+		debug_e("[HSPI] Graph dependency invalid: 0x%08x", dependsOn);
+		return -1;
+	}
+
+	for(unsigned i = 0; i < nodeCount; ++i) {
+		if(nodes[i].request == &request) {
+			debug_e("[HSPI] Request already in graph");
+			return -1;
+		}
+	}
+
+	nodes[nodeCount] = Node{&device, &request, nullptr, nullptr, dependsOn, 0};
+	return nodeCount++;
+}
+
+bool RequestGraph::execute(InterruptDelegate callback)
+{
+	if(nodeCount == 0 || isBusy()) {
+		return false;
+	}
+
+	if(token == nullptr) {
+		token = new TaskToken{this};
+		if(token == nullptr) {
+			return false;
+		}
+	}
+
+	// Make sure requests aren't in use from a previous run before changing them
+	for(unsigned i = 0; i < nodeCount; ++i) {
+		nodes[i].device->wait(*nodes[i].request);
+	}
+
+	this->callback = callback;
+
+	for(unsigned i = 0; i < nodeCount; ++i) {
+		auto& node = nodes[i];
+		node.pending = __builtin_popcount(node.dependsOn);
+		node.callback = node.request->callback;
+		node.param = node.request->param;
+		node.request->setAsync(requestComplete, this);
+	}
+
+	remaining = (nodeCount == maxNodes) ? ~Mask(0) : bit(nodeCount) - 1;
+	started = 0;
+
+	// Successors may be started from interrupt context as soon as the first request completes
+	for(unsigned i = 0; i < nodeCount; ++i) {
+		auto& node = nodes[i];
+		if(node.pending == 0) {
+			started |= bit(i);
+			node.device->execute(*node.request);
+		}
+	}
+
+	return true;
+}
+
+void RequestGraph::wait()
+{
+	while(isBusy()) {
+		// Nodes not yet started aren't busy so waiting on them would just spin
+		Mask active = remaining & started;
+		for(unsigned i = 0; i < nodeCount; ++i) {
+			if(active & bit(i)) {
+				nodes[i].device->wait(*nodes[i].request);
+			}
+		}
+	}
+	complete();
+}
+
+void RequestGraph::clear()
+{
+	wait();
+	nodeCount = 0;
+}
+
+void RequestGraph::complete()
+{
+	if(isBusy() || !callback) {
+		return;
+	}
+
+	auto cb = callback;
+	callback = nullptr;
+	cb();
+}
+
+/*
+ * Called in interrupt context for each node.
+ * Successors are executed directly: the controller queues them when completion processing has finished.
+ */
+bool IRAM_ATTR RequestGraph::requestComplete(Request& request)
+{
+	auto self = static_cast<RequestGraph*>(request.param);
+
+	unsigned index = 0;
+	while(self->nodes[index].request != &request) {
+		++index;
+	}
+	auto& node = self->nodes[index];
+
+	// Restore request so the node's own callback sees it as prepared
+	request.callback = node.callback;
+	request.param = node.param;
+	if(node.callback != nullptr && !node.callback(request)) {
+		request.callback = requestComplete;
+		request.param = self;
+		return false;
+	}
+
+	for(unsigned i = index + 1; i < self->nodeCount; ++i) {
+		auto& succ = self->nodes[i];
+		if((succ.dependsOn & bit(index)) && --succ.pending == 0) {
+			self->started |= bit(i);
+			succ.device->execute(*succ.request);
+		}
+	}
+
+	// Task must be queued before the graph is seen to be idle, as it may then be destroyed
+	Mask remaining = self->remaining & ~bit(index);
+	if(remaining == 0 && !self->taskQueued) {
+		self->taskQueued = true;
+		System.queueCallback(
+			[](void* param) {
+				auto token = static_cast<TaskToken*>(param);
+				auto self = token->graph;
+				if(self == nullptr) {
+					// Graph was destroyed whilst task was queued
+					delete token;
+					return;
+				}
+				self->taskQueued = false;
+				self->complete();
+			},
+			self->token);
+	}
+	self->remaining = remaining;
+
+	return true;
+}
+
+} // namespace HSPI
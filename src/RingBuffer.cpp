@@ -0,0 +1,233 @@
+/**
+ * RingBuffer.cpp
+ *
+ * Copyright 2021 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the HardwareSPI Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#include "include/HSPI/RingBuffer.h"
+#include <cstring>
+
+/*
+ * Buffer layout: head buffers [0, 1] followed by tail buffers [0, 1]
+ */
+#define HEAD_BUFFER(i) (buffer + (i)*bufferSize)
+#define TAIL_BUFFER(i) (buffer + (bufCount + (i)) * bufferSize)
+
+namespace HSPI
+{
+namespace
+{
+bool isPowerOf2(uint32_t value)
+{
+	return value != 0 && (value & (value - 1)) == 0;
+}
+
+} // namespace
+
+bool RingBuffer::begin()
+{
+	if(!isPowerOf2(capacity) || !isPowerOf2(bufferSize) || bufferSize > 0x4000 || capacity < bufCount * bufferSize ||
+	   baseAddress + capacity > device.getSize()) {
+		debug_e("[HSPI] RingBuffer parameters invalid");
+		return false;
+	}
+
+	if(buffer == nullptr) {
+		buffer = new uint8_t[bufCount * 2 * bufferSize];
+		if(buffer == nullptr) {
+			return false;
+		}
+	}
+
+	clear();
+	return true;
+}
+
+void RingBuffer::end()
+{
+	if(buffer == nullptr) {
+		return;
+	}
+
+	clear();
+	delete[] buffer;
+	buffer = nullptr;
+}
+
+void RingBuffer::clear()
+{
+	for(unsigned i = 0; i < bufCount; ++i) {
+		device.wait(headReq[i]);
+		device.wait(tailReq[i]);
+		tailValid[i] = false;
+	}
+
+	pushPos = popPos = headStart = 0;
+	headLen = 0;
+	headIndex = 0;
+}
+
+/*
+ * Start writing the current (full) head buffer and switch to the other one.
+ * Returns false if the other buffer is still being written.
+ */
+bool RingBuffer::writeHead()
+{
+	auto next = headIndex ^ 1;
+	if(headReq[next].busy) {
+		return false;
+	}
+
+	device.write(headReq[headIndex], getAddress(headStart), HEAD_BUFFER(headIndex), bufferSize);
+	++stats.blocksWritten;
+
+	// Previous head buffer still holds valid data until next switch
+	headIndex = next;
+	headStart += bufferSize;
+	headLen = 0;
+	return true;
+}
+
+size_t RingBuffer::push(const void* data, size_t len)
+{
+	if(buffer == nullptr) {
+		return 0;
+	}
+
+	auto src = static_cast<const uint8_t*>(data);
+	len = std::min(len, space());
+	size_t done{0};
+	while(done < len) {
+		if(headLen == bufferSize && !writeHead()) {
+			++stats.pushStalls;
+			break;
+		}
+		auto count = std::min(len - done, size_t(bufferSize - headLen));
+		memcpy(HEAD_BUFFER(headIndex) + headLen, &src[done], count);
+		headLen += count;
+		pushPos += count;
+		done += count;
+	}
+
+	// Get full buffer on the bus as soon as possible
+	if(headLen == bufferSize) {
+		writeHead();
+	}
+
+	return done;
+}
+
+/*
+ * Find data for a stream position.
+ * The current and previous blocks are always in head buffers. Older blocks must come from the device.
+ */
+const uint8_t* RingBuffer::locate(uint32_t pos, size_t& avail)
+{
+	auto block = getBlock(pos);
+	auto offset = pos - block;
+
+	if(block == headStart) {
+		avail = headLen - offset;
+		return HEAD_BUFFER(headIndex) + offset;
+	}
+
+	avail = bufferSize - offset;
+
+	if(block + bufferSize == headStart) {
+		return HEAD_BUFFER(headIndex ^ 1) + offset;
+	}
+
+	for(unsigned i = 0; i < bufCount; ++i) {
+		if(tailValid[i] && tailStart[i] == block) {
+			return tailReq[i].busy ? nullptr : TAIL_BUFFER(i) + offset;
+		}
+	}
+
+	return nullptr;
+}
+
+/*
+ * Start reading device-resident blocks at the read position into tail buffers
+ */
+void RingBuffer::prefetch()
+{
+	auto block = getBlock(popPos);
+	for(unsigned n = 0; n < bufCount; ++n, block += bufferSize) {
+		// Only blocks older than previous head have been written to the device
+		if(int32_t(headStart - block) <= int32_t(bufferSize)) {
+			break;
+		}
+
+		int slot{-1};
+		for(unsigned i = 0; i < bufCount; ++i) {
+			if(tailValid[i] && tailStart[i] == block) {
+				slot = i;
+				break;
+			}
+		}
+		if(slot >= 0) {
+			continue;
+		}
+
+		// Re-use a buffer which doesn't contain data at read position
+		for(unsigned i = 0; i < bufCount; ++i) {
+			if(!tailReq[i].busy && (!tailValid[i] || tailStart[i] != getBlock(popPos))) {
+				slot = i;
+				break;
+			}
+		}
+		if(slot < 0) {
+			break;
+		}
+
+		tailStart[slot] = block;
+		tailValid[slot] = true;
+		device.read(tailReq[slot], getAddress(block), TAIL_BUFFER(slot), bufferSize);
+		++stats.blocksRead;
+	}
+}
+
+size_t RingBuffer::pop(void* buffer, size_t len)
+{
+	if(this->buffer == nullptr) {
+		return 0;
+	}
+
+	auto dst = static_cast<uint8_t*>(buffer);
+	len = std::min(len, available());
+	size_t done{0};
+	while(done < len) {
+		size_t avail;
+		auto src = locate(popPos, avail);
+		if(src == nullptr) {
+			++stats.popStalls;
+			break;
+		}
+		auto count = std::min(len - done, avail);
+		memcpy(&dst[done], src, count);
+		if(headStart - getBlock(popPos) <= bufferSize) {
+			stats.bytesFromHead += count;
+		}
+		popPos += count;
+		done += count;
+	}
+
+	prefetch();
+
+	return done;
+}
+
+} // namespace HSPI
@@ -0,0 +1,237 @@
+/**
+ * ShadowFramebuffer.cpp
+ *
+ * Copyright 2021 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the HardwareSPI Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#include "include/HSPI/ShadowFramebuffer.h"
+#include <Platform/System.h>
+#include <cstring>
+
+namespace HSPI
+{
+bool ShadowFramebuffer::begin(bool load)
+{
+	if(buffer != nullptr) {
+		return true;
+	}
+
+	if(width == 0 || height == 0 || bytesPerPixel == 0 || tileSize == 0 || uint32_t(width) * bytesPerPixel > 0x7fff ||
+	   address + uint32_t(getStride()) * height > device.getSize()) {
+		debug_e("[HSPI] Framebuffer parameters invalid");
+		return false;
+	}
+
+	tilesX = (width + tileSize - 1) / tileSize;
+	tilesY = (height + tileSize - 1) / tileSize;
+	auto words = (tilesX * tilesY + 31) / 32;
+	buffer = new uint8_t[getStride() * height];
+	dirty = new uint32_t[words];
+	if(buffer == nullptr || dirty == nullptr) {
+		end();
+		return false;
+	}
+
+	memset(dirty, 0, words * sizeof(uint32_t));
+	if(load) {
+		device.readRect(address, getStride(), buffer, getStride(), getStride(), height);
+	} else {
+		memset(buffer, 0, getStride() * height);
+		markAllDirty();
+	}
+
+	return true;
+}
+
+void ShadowFramebuffer::end()
+{
+	wait();
+	delete[] dirty;
+	dirty = nullptr;
+	delete[] buffer;
+	buffer = nullptr;
+}
+
+void ShadowFramebuffer::markDirty(uint16_t x, uint16_t y, uint16_t w, uint16_t h)
+{
+	if(dirty == nullptr || x >= width || y >= height || w == 0 || h == 0) {
+		return;
+	}
+
+	unsigned tx0 = x / tileSize;
+	unsigned ty0 = y / tileSize;
+	unsigned tx1 = (std::min(unsigned(width), unsigned(x) + w) - 1) / tileSize;
+	unsigned ty1 = (std::min(unsigned(height), unsigned(y) + h) - 1) / tileSize;
+	for(unsigned ty = ty0; ty <= ty1; ++ty) {
+		for(unsigned tx = tx0; tx <= tx1; ++tx) {
+			auto i = ty * tilesX + tx;
+			dirty[i / 32] |= 1U << (i % 32);
+		}
+	}
+}
+
+void ShadowFramebuffer::writeRect(uint16_t x, uint16_t y, uint16_t w, uint16_t h, const void* data)
+{
+	if(buffer == nullptr || x >= width || y >= height) {
+		return;
+	}
+
+	auto src = static_cast<const uint8_t*>(data);
+	unsigned srcStride = w * bytesPerPixel;
+	w = std::min(w, uint16_t(width - x));
+	h = std::min(h, uint16_t(height - y));
+	for(unsigned row = 0; row < h; ++row) {
+		memcpy(getPixel(x, y + row), &src[row * srcStride], w * bytesPerPixel);
+	}
+	markDirty(x, y, w, h);
+}
+
+/*
+ * Find first dirty tile and grow it into the largest rectangle:
+ * across as far as the run of dirty tiles extends, then down while the same span is dirty.
+ * Tiles are marked clean as they're taken.
+ */
+bool ShadowFramebuffer::getNextRect(TileRect& rect)
+{
+	for(; scanRow < tilesY; ++scanRow) {
+		unsigned tx = 0;
+		while(tx < tilesX && !isDirty(tx, scanRow)) {
+			++tx;
+		}
+		if(tx == tilesX) {
+			continue;
+		}
+
+		rect.x = tx;
+		rect.y = scanRow;
+		while(tx < tilesX && isDirty(tx, scanRow)) {
+			++tx;
+		}
+		rect.w = tx - rect.x;
+
+		unsigned ty = scanRow + 1;
+		for(; ty < tilesY; ++ty) {
+			unsigned n = 0;
+			while(n < rect.w && isDirty(rect.x + n, ty)) {
+				++n;
+			}
+			if(n < rect.w) {
+				break;
+			}
+		}
+		rect.h = ty - rect.y;
+
+		for(ty = rect.y; ty < rect.y + rect.h; ++ty) {
+			for(tx = rect.x; tx < rect.x + rect.w; ++tx) {
+				clearDirty(tx, ty);
+			}
+		}
+		return true;
+	}
+
+	return false;
+}
+
+bool ShadowFramebuffer::startNextRect()
+{
+	TileRect rect;
+	while(getNextRect(rect)) {
+		// Convert to pixels, clipping partial tiles at right and bottom edges
+		unsigned x = rect.x * tileSize;
+		unsigned y = rect.y * tileSize;
+		unsigned w = std::min(unsigned(rect.w * tileSize), width - x);
+		unsigned h = std::min(unsigned(rect.h * tileSize), height - y);
+
+		auto stride = getStride();
+		auto offset = y * stride + x * bytesPerPixel;
+		auto rowLength = w * bytesPerPixel;
+		// Nothing is started for an empty rectangle, so there'd be no completion callback
+		if(!device.writeRect(req, address + offset, stride, &buffer[offset], stride, rowLength, h, requestComplete,
+							 this)) {
+			continue;
+		}
+
+		++stats.rects;
+		stats.tiles += rect.w * rect.h;
+		stats.bytesUploaded += rowLength * h;
+		return true;
+	}
+
+	return false;
+}
+
+bool ShadowFramebuffer::update(InterruptDelegate callback)
+{
+	if(buffer == nullptr || active) {
+		return false;
+	}
+
+	scanRow = 0;
+	this->callback = callback;
+	active = true;
+	if(startNextRect()) {
+		++stats.updates;
+		return true;
+	}
+
+	// Nothing to do
+	active = false;
+	this->callback = nullptr;
+	if(callback) {
+		callback();
+	}
+	return true;
+}
+
+void ShadowFramebuffer::wait()
+{
+	while(active) {
+		device.wait(req);
+		task();
+	}
+}
+
+void ShadowFramebuffer::task()
+{
+	taskQueued = false;
+
+	if(!active || req.busy) {
+		return;
+	}
+
+	if(startNextRect()) {
+		return;
+	}
+
+	active = false;
+	if(callback) {
+		auto cb = callback;
+		callback = nullptr;
+		cb();
+	}
+}
+
+bool IRAM_ATTR ShadowFramebuffer::requestComplete(Request& req)
+{
+	auto self = static_cast<ShadowFramebuffer*>(req.param);
+	if(!self->taskQueued) {
+		self->taskQueued = true;
+		System.queueCallback([](void* param) { static_cast<ShadowFramebuffer*>(param)->task(); }, self);
+	}
+	return true;
+}
+
+} // namespace HSPI
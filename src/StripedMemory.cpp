@@ -0,0 +1,68 @@
+/**
+ * StripedMemory.cpp
+ *
+ * Copyright 2021 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the HardwareSPI Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#include "include/HSPI/StripedMemory.h"
+
+namespace HSPI
+{
+size_t StripedMemory::getSize() const
+{
+	if(memberCount == 0) {
+		return 0;
+	}
+
+	size_t size = members[0].device->getSize();
+	for(unsigned i = 1; i < memberCount; ++i) {
+		size = std::min(size, members[i].device->getSize());
+	}
+
+	return (size / stripeSize) * stripeSize * memberCount;
+}
+
+void StripedMemory::startOperation()
+{
+	uint32_t startStripe = op.address / stripeSize;
+	endStripe = 1 + (op.address + op.length - 1) / stripeSize;
+
+	// Each member starts at the first stripe it owns
+	auto firstMember = startStripe % memberCount;
+	for(unsigned i = 0; i < memberCount; ++i) {
+		members[i].position = startStripe + (i + memberCount - firstMember) % memberCount;
+	}
+}
+
+bool IRAM_ATTR StripedMemory::getSegment(Member& member, Segment& segment)
+{
+	auto stripe = member.position;
+	if(stripe >= endStripe) {
+		return false;
+	}
+
+	uint32_t stripeStart = stripe * stripeSize;
+	auto start = std::max(op.address, stripeStart);
+	auto end = std::min(op.address + op.length, stripeStart + stripeSize);
+	segment.address = (stripe / memberCount) * stripeSize + (start - stripeStart);
+	segment.buffer = op.buffer + (start - op.address);
+	segment.length = end - start;
+
+	member.position = stripe + memberCount;
+	return true;
+}
+
+} // namespace HSPI
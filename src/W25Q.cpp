@@ -0,0 +1,367 @@
+/**
+ * W25Q.cpp
+ *
+ * Copyright 2021 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the HardwareSPI Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#include "include/HSPI/Flash/W25Q.h"
+#include <Platform/System.h>
+
+namespace HSPI
+{
+namespace Flash
+{
+namespace
+{
+// Commands
+constexpr uint8_t CMD_WRITE_ENABLE{0x06};
+constexpr uint8_t CMD_READ_STATUS1{0x05};
+constexpr uint8_t CMD_READ_STATUS2{0x35};
+constexpr uint8_t CMD_WRITE_STATUS2{0x31};
+constexpr uint8_t CMD_PAGE_PROGRAM{0x02};
+constexpr uint8_t CMD_QUAD_PAGE_PROGRAM{0x32};
+constexpr uint8_t CMD_SECTOR_ERASE{0x20};
+constexpr uint8_t CMD_BLOCK_ERASE_32K{0x52};
+constexpr uint8_t CMD_BLOCK_ERASE_64K{0xD8};
+constexpr uint8_t CMD_CHIP_ERASE{0xC7};
+constexpr uint8_t CMD_RELEASE_POWER_DOWN{0xAB};
+constexpr uint8_t CMD_JEDEC_ID{0x9F};
+
+// Status register bits
+constexpr uint8_t STATUS1_BUSY{0x01};
+constexpr uint8_t STATUS2_QE{0x02};
+
+constexpr uint32_t block32Size{0x8000};
+constexpr uint32_t block64Size{0x10000};
+
+} // namespace
+
+bool W25Q::begin(PinSet pinSet, uint8_t chipSelect, uint32_t clockSpeed)
+{
+	if(!MemoryDevice::begin(pinSet, chipSelect, clockSpeed)) {
+		return false;
+	}
+
+	setBitOrder(MSBFIRST);
+	setClockMode(ClockMode::mode0);
+	MemoryDevice::setIoMode(IoMode::SPIHD);
+
+	sendCommand(CMD_RELEASE_POWER_DOWN);
+
+	auto id = readId();
+	auto capacity = id & 0xff;
+	if(capacity < 0x10 || capacity > 0x20) {
+		debug_e("[HSPI] Flash ID invalid: 0x%06x", id);
+		end();
+		return false;
+	}
+
+	// Only 24-bit addressing is supported
+	size = (capacity >= 24) ? 0x1000000U : 1U << capacity;
+	return true;
+}
+
+void W25Q::sendCommand(uint8_t cmd)
+{
+	Request r;
+	r.setIoMode(IoMode::SPIHD);
+	r.setCommand8(cmd);
+	execute(r);
+}
+
+uint32_t W25Q::readId()
+{
+	Request r;
+	r.setIoMode(IoMode::SPIHD);
+	r.setCommand8(CMD_JEDEC_ID);
+	r.in.set32(0, 3);
+	execute(r);
+	// Bytes received in order manufacturer, type, capacity
+	auto id = r.in.data;
+	return (id[0] << 16) | (id[1] << 8) | id[2];
+}
+
+uint8_t W25Q::readStatus(uint8_t cmd)
+{
+	Request r;
+	r.setIoMode(IoMode::SPIHD);
+	r.setCommand8(cmd);
+	r.in.set8(0);
+	execute(r);
+	return r.in.data8;
+}
+
+void W25Q::waitReady()
+{
+	while(readStatus(CMD_READ_STATUS1) & STATUS1_BUSY) {
+		++stats.statusPolls;
+	}
+}
+
+bool W25Q::setIoMode(IoMode mode)
+{
+	if(!isSupported(mode)) {
+		debug_e("[HSPI] setIoMode(): Mode %u invalid", unsigned(mode));
+		return false;
+	}
+
+	wait();
+
+	if(mode == IoMode::QUAD || mode == IoMode::QIO) {
+		// Quad Enable bit is non-volatile so only write it if necessary
+		auto status2 = readStatus(CMD_READ_STATUS2);
+		if((status2 & STATUS2_QE) == 0) {
+			sendCommand(CMD_WRITE_ENABLE);
+			Request r;
+			r.setIoMode(IoMode::SPIHD);
+			r.setCommand8(CMD_WRITE_STATUS2);
+			r.out.set8(status2 | STATUS2_QE);
+			execute(r);
+			waitReady();
+		}
+	}
+
+	return MemoryDevice::setIoMode(mode);
+}
+
+void W25Q::prepareWrite(HSPI::Request& req, uint32_t address)
+{
+	wait(req);
+	if(isQuad()) {
+		req.setIoMode(IoMode::QUAD);
+		req.setCommand8(CMD_QUAD_PAGE_PROGRAM);
+	} else {
+		req.setIoMode(IoMode::SPIHD);
+		req.setCommand8(CMD_PAGE_PROGRAM);
+	}
+	req.setAddress24(address);
+	req.dummyLen = 0;
+}
+
+void W25Q::prepareRead(HSPI::Request& req, uint32_t address)
+{
+	wait(req);
+	req.clearIoMode();
+	switch(getIoMode()) {
+	case IoMode::DUAL:
+		req.setCommand8(0x3B); // Fast Read Dual Output
+		req.dummyLen = 8;
+		break;
+	case IoMode::DIO:
+		// Mode bits are sent as dummy cycles: lines are pulled up so continuous read mode isn't selected
+		req.setCommand8(0xBB); // Fast Read Dual I/O
+		req.dummyLen = 4;
+		break;
+	case IoMode::QUAD:
+		req.setCommand8(0x6B); // Fast Read Quad Output
+		req.dummyLen = 8;
+		break;
+	case IoMode::QIO:
+		req.setCommand8(0xEB); // Fast Read Quad I/O
+		req.dummyLen = 6;
+		break;
+	default:
+		req.setCommand8(0x0B); // Fast Read
+		req.dummyLen = 8;
+	}
+	req.setAddress24(address);
+}
+
+bool W25Q::program(uint32_t address, const void* data, size_t len, InterruptDelegate callback)
+{
+	if(len == 0 || len > size || address > size - len) {
+		debug_e("[HSPI] Flash program range invalid: 0x%08x, %u", address, len);
+		return false;
+	}
+
+	return start(Operation{static_cast<const uint8_t*>(data), address, uint32_t(len), 0}, callback);
+}
+
+bool W25Q::erase(uint32_t address, size_t len, InterruptDelegate callback)
+{
+	if(len == 0 || address % sectorSize != 0 || len % sectorSize != 0 || len > size || address > size - len) {
+		debug_e("[HSPI] Flash erase range invalid: 0x%08x, %u", address, len);
+		return false;
+	}
+
+	return start(Operation{nullptr, address, uint32_t(len), CMD_SECTOR_ERASE}, callback);
+}
+
+bool W25Q::eraseChip(InterruptDelegate callback)
+{
+	return start(Operation{nullptr, 0, size, CMD_CHIP_ERASE}, callback);
+}
+
+bool W25Q::start(const Operation& operation, InterruptDelegate callback)
+{
+	if(phase != Phase::idle) {
+		debug_e("[HSPI] Flash busy");
+		return false;
+	}
+
+	wait(req);
+	op = operation;
+	this->callback = callback;
+	setWriteEnable();
+	req.setAsync(requestComplete, this);
+	execute(req);
+	return true;
+}
+
+void W25Q::wait()
+{
+	while(phase != Phase::idle) {
+		MemoryDevice::wait(req);
+	}
+	complete();
+}
+
+void IRAM_ATTR W25Q::setWriteEnable()
+{
+	phase = Phase::writeEnable;
+	req.requeueDelay = 0;
+	req.setIoMode(IoMode::SPIHD);
+	req.setCommand8(CMD_WRITE_ENABLE);
+	req.addrLen = 0;
+	req.dummyLen = 0;
+	req.out.clear();
+	req.in.clear();
+}
+
+/*
+ * Set up program or erase command, then advance to the next page or block
+ * so the following step is ready to go as soon as the device is.
+ */
+void IRAM_ATTR W25Q::setOperation()
+{
+	phase = Phase::command;
+	req.requeueDelay = 0;
+	req.in.clear();
+
+	if(op.eraseCmd == CMD_CHIP_ERASE) {
+		req.setIoMode(IoMode::SPIHD);
+		req.setCommand8(CMD_CHIP_ERASE);
+		req.addrLen = 0;
+		req.out.clear();
+		op.remaining = 0;
+		++stats.erases;
+		return;
+	}
+
+	req.setAddress24(op.address);
+
+	if(op.eraseCmd != 0) {
+		uint32_t blockSize;
+		if(op.address % block64Size == 0 && op.remaining >= block64Size) {
+			req.setCommand8(CMD_BLOCK_ERASE_64K);
+			blockSize = block64Size;
+		} else if(op.address % block32Size == 0 && op.remaining >= block32Size) {
+			req.setCommand8(CMD_BLOCK_ERASE_32K);
+			blockSize = block32Size;
+		} else {
+			req.setCommand8(CMD_SECTOR_ERASE);
+			blockSize = sectorSize;
+		}
+		req.setIoMode(IoMode::SPIHD);
+		req.out.clear();
+		op.address += blockSize;
+		op.remaining -= blockSize;
+		++stats.erases;
+		return;
+	}
+
+	auto count = std::min(op.remaining, uint32_t(pageSize - (op.address % pageSize)));
+	if(isQuad()) {
+		req.setIoMode(IoMode::QUAD);
+		req.setCommand8(CMD_QUAD_PAGE_PROGRAM);
+	} else {
+		req.setIoMode(IoMode::SPIHD);
+		req.setCommand8(CMD_PAGE_PROGRAM);
+	}
+	req.out.set(op.data, count);
+	op.data += count;
+	op.address += count;
+	op.remaining -= count;
+	++stats.pagesProgrammed;
+}
+
+void IRAM_ATTR W25Q::setPoll()
+{
+	phase = Phase::poll;
+	// Device will be busy for a while so hold back first read as well
+	req.requeueDelay = pollInterval;
+	req.setIoMode(IoMode::SPIHD);
+	req.setCommand8(CMD_READ_STATUS1);
+	req.addrLen = 0;
+	req.out.clear();
+	req.in.set8(0);
+}
+
+void W25Q::complete()
+{
+	taskQueued = false;
+
+	if(phase != Phase::idle || !callback) {
+		return;
+	}
+
+	auto cb = callback;
+	callback = nullptr;
+	cb();
+}
+
+/*
+ * Each step re-queues the request for the next one.
+ * Status reads are re-queued after the poll interval, which allows other requests to run in between.
+ */
+bool IRAM_ATTR W25Q::requestComplete(Request& request)
+{
+	auto self = static_cast<W25Q*>(request.param);
+
+	switch(self->phase) {
+	case Phase::writeEnable:
+		self->setOperation();
+		return false;
+
+	case Phase::command:
+		self->setPoll();
+		return false;
+
+	case Phase::poll:
+		if(request.in.data8 & STATUS1_BUSY) {
+			++self->stats.statusPolls;
+			return false;
+		}
+		if(self->op.remaining != 0) {
+			self->setWriteEnable();
+			return false;
+		}
+		break;
+
+	case Phase::idle:
+		break;
+	}
+
+	self->phase = Phase::idle;
+	if(!self->taskQueued) {
+		self->taskQueued = true;
+		System.queueCallback([](void* param) { static_cast<W25Q*>(param)->complete(); }, self);
+	}
+	return true;
+}
+
+} // namespace Flash
+} // namespace HSPI
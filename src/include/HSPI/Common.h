@@ -57,7 +57,7 @@ enum class IoMode : uint8_t {
 	SQI,	  ///< Four bits per clock for Command, Address and Data
 };
 
-using IoModes = BitSet<uint8_t, IoMode>;
+using IoModes = BitSet<uint16_t, IoMode>;
 
 inline constexpr IoModes operator|(IoMode a, IoMode b)
 {
@@ -96,6 +96,17 @@ inline String toString(IoMode mode)
 	return *getIoModeInfo(mode).name;
 }
 
+/**
+ * @brief Determine number of bus clock cycles required for a single transaction
+ * @param mode IO mode in use
+ * @param cmdLen Command bits
+ * @param addrLen Address bits
+ * @param dummyLen Dummy clock cycles
+ * @param dataLength Number of data bytes
+ * @retval uint32_t Clock cycles on the wire, excluding any CS setup/hold time
+ */
+uint32_t getTransactionClocks(IoMode mode, uint8_t cmdLen, uint8_t addrLen, uint8_t dummyLen, size_t dataLength);
+
 // 0 for LSBFIRST, non-zero for MSBFIRST
 using ByteOrder = uint8_t;
 using BitOrder = uint8_t;
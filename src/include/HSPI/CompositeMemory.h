@@ -0,0 +1,205 @@
+/****
+ * CompositeMemory.h
+ *
+ * Copyright 2021 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the HardwareSPI Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#pragma once
+
+#include "MemoryDevice.h"
+#include <Interrupts.h>
+
+namespace HSPI
+{
+/**
+ * @brief Base class for presenting several memory devices as a single address space
+ *
+ * Each member device has its own request. An operation is split into segments for each member,
+ * which are executed in parallel. Subsequent segments for a member are issued from the completion
+ * callback by re-queuing the request, so the CPU is only involved at the start and end of an operation.
+ *
+ * Member devices may be attached to the same or different controllers.
+ * Throughput scales with the number of controllers in use.
+ *
+ * @ingroup hw_spi
+ */
+class CompositeMemory
+{
+public:
+	static constexpr size_t maxMembers{4};
+
+	virtual ~CompositeMemory()
+	{
+	}
+
+	/**
+	 * @brief Add a memory device
+	 * @param device Must already be initialised
+	 * @retval bool false if member table is full or an operation is in progress
+	 */
+	bool addMember(MemoryDevice& device);
+
+	unsigned getMemberCount() const
+	{
+		return memberCount;
+	}
+
+	MemoryDevice& getMember(unsigned index) const
+	{
+		return *members[index].device;
+	}
+
+	/**
+	 * @brief Number of bytes read from a member device
+	 */
+	uint32_t getBytesRead(unsigned index) const
+	{
+		return members[index].bytesRead;
+	}
+
+	/**
+	 * @brief Number of bytes written to a member device
+	 */
+	uint32_t getBytesWritten(unsigned index) const
+	{
+		return members[index].bytesWritten;
+	}
+
+	/**
+	 * @brief Number of requests outstanding on the controller a member device is attached to
+	 */
+	uint8_t getQueueDepth(unsigned index) const
+	{
+		return members[index].device->controller.getQueueDepth();
+	}
+
+	/**
+	 * @brief Get size of the combined address space
+	 */
+	virtual size_t getSize() const = 0;
+
+	/**
+	 * @brief Start an asynchronous read
+	 * @param address
+	 * @param buffer
+	 * @param len
+	 * @param callback Invoked in task context when all members have completed
+	 * @retval bool false if parameters are invalid or an operation is already in progress
+	 */
+	bool read(uint32_t address, void* buffer, size_t len, InterruptDelegate callback);
+
+	/**
+	 * @brief Start an asynchronous write
+	 * @param address
+	 * @param data
+	 * @param len
+	 * @param callback Invoked in task context when all members have completed
+	 * @retval bool false if parameters are invalid or an operation is already in progress
+	 */
+	bool write(uint32_t address, const void* data, size_t len, InterruptDelegate callback);
+
+	/**
+	 * @brief Read a block of data (blocking)
+	 */
+	bool read(uint32_t address, void* buffer, size_t len)
+	{
+		if(!read(address, buffer, len, nullptr)) {
+			return false;
+		}
+		wait();
+		return true;
+	}
+
+	/**
+	 * @brief Write a block of data (blocking)
+	 */
+	bool write(uint32_t address, const void* data, size_t len)
+	{
+		if(!write(address, data, len, nullptr)) {
+			return false;
+		}
+		wait();
+		return true;
+	}
+
+	/**
+	 * @brief Determine if an operation is in progress
+	 */
+	bool isBusy() const
+	{
+		return active;
+	}
+
+	/**
+	 * @brief Block until current operation has completed
+	 */
+	void wait();
+
+protected:
+	struct Member {
+		CompositeMemory* owner;
+		MemoryDevice* device;
+		Request req;
+		uint32_t position; ///< Interpreted by subclass
+		uint32_t limit;	///< Interpreted by subclass
+		uint32_t bytesRead;
+		uint32_t bytesWritten;
+		volatile bool done;
+	};
+
+	struct Segment {
+		uint32_t address; ///< Member device address
+		uint8_t* buffer;
+		uint16_t length;
+	};
+
+	struct Operation {
+		uint32_t address;
+		uint8_t* buffer;
+		size_t length;
+		bool isWrite;
+	};
+
+	/**
+	 * @brief Called in task context to initialise member positions for a new operation (see `op`)
+	 */
+	virtual void startOperation() = 0;
+
+	/**
+	 * @brief Get next segment to transfer for a member
+	 * @param member
+	 * @param segment On return, contains segment details
+	 * @retval bool false if member has no further segments
+	 * @note Called from interrupt context so implementations MUST be in IRAM
+	 */
+	virtual bool getSegment(Member& member, Segment& segment) = 0;
+
+	Operation op{};
+	Member members[maxMembers]{};
+	uint8_t memberCount{0};
+
+private:
+	bool start(uint32_t address, uint8_t* buffer, size_t len, bool isWrite, InterruptDelegate callback);
+	void setSegment(Member& member, const Segment& segment);
+	void complete();
+	static bool requestComplete(Request& req);
+
+	InterruptDelegate callback;
+	volatile bool active{false};
+	volatile bool taskQueued{false};
+};
+
+} // namespace HSPI
@@ -85,11 +85,13 @@
 #include <stdint.h>
 #include <esp_attr.h>
 #include "Request.h"
+#include <SimpleTimer.h>
 #include <bitset>
 #include "Common.h"
 
 #ifdef ARCH_ESP32
 #include <soc/soc_caps.h>
+#include <freertos/FreeRTOS.h>
 struct spi_transaction_t;
 struct spi_device_t;
 #endif
@@ -142,6 +144,8 @@ class Controller
 public:
 #ifdef ARCH_ESP32
 	static constexpr size_t hardwareBufferSize{4096 - 4}; // SPI_MAX_DMA_LEN
+	static constexpr size_t dmaBufferCount{2};			  ///< Bounce buffers for non-DMA-capable data
+	static constexpr size_t transactionSlots{4};		  ///< Depth of hardware transaction queue
 #else
 	static constexpr size_t hardwareBufferSize{64};
 #endif
@@ -152,13 +156,14 @@ public:
 #else
 		bool dirty{true}; ///< Set when values require updating
 		// Pre-calculated register values - see updateConfig()
-		struct {
+		struct Regs {
 			uint32_t clock{0};
 			uint32_t ctrl{0};
 			uint32_t pin{0};
 			uint32_t user{0};
 			uint32_t user1{0};
-		} reg;
+		};
+		Regs reg;
 #endif
 	};
 
@@ -218,6 +223,13 @@ public:
 	 */
 	virtual void stopDevice(Device& dev);
 
+	/**
+	 * @brief Change bus speed for a device
+	 * @param dev Device, which must be started and idle
+	 * @param clockSpeed Requested speed. Actual speed is available via Device::getSpeed().
+	 */
+	bool setSpeed(Device& dev, uint32_t clockSpeed);
+
 	/**
 	 * @brief Devices call this method to tell the Controller about configuration changes.
 	 * Internally, we just set a flag and update the register values when required.
@@ -251,6 +263,16 @@ public:
 		uint32_t waitCycles;	 ///< Total blocking CPU cycles
 		uint32_t tasksQueued;	///< Number of times task callback registered for async execution (no interrupts)
 		uint32_t tasksCancelled; ///< Tasks cancelled by blocking requests
+		uint32_t bounceCopyOut;  ///< Outgoing bytes copied into DMA bounce buffers
+		uint32_t bounceCopyIn;   ///< Incoming bytes copied out of DMA bounce buffers
+		uint32_t completeInterrupt; ///< Adaptive policy: requests completed via interrupt
+		uint32_t completeTask;		///< Adaptive policy: requests completed by task polling
+		uint32_t completePoll;		///< Adaptive policy: requests completed by inline polling
+		uint32_t configSwitches;	///< Number of times clock/ctrl/pin registers were reloaded
+		uint32_t switchesAvoided;   ///< Requests brought forward to avoid a configuration switch
+		uint32_t requestsMerged;	///< Requests combined into a preceding burst
+		uint32_t verifyFailed;		///< Verify requests which found a mismatch
+		uint32_t requestsParked;	///< Requests re-queued after a delay
 
 		void clear() volatile
 		{
@@ -259,6 +281,16 @@ public:
 			waitCycles = 0;
 			tasksQueued = 0;
 			tasksCancelled = 0;
+			bounceCopyOut = 0;
+			bounceCopyIn = 0;
+			completeInterrupt = 0;
+			completeTask = 0;
+			completePoll = 0;
+			configSwitches = 0;
+			switchesAvoided = 0;
+			requestsMerged = 0;
+			verifyFailed = 0;
+			requestsParked = 0;
 		}
 	};
 	static volatile Stats stats;
@@ -269,6 +301,69 @@ public:
 		return activePinSet;
 	}
 
+#ifndef ARCH_ESP32
+	/**
+	 * @brief Enable automatic selection of completion handling for asynchronous requests
+	 *
+	 * The time taken to service a completion interrupt is measured continuously.
+	 * When enabled, this is compared against the expected time on the wire for each request,
+	 * based on clock speed, IO mode and data length. The controller then chooses:
+	 *
+	 * - Interrupt: Transactions take longer than the interrupt overhead
+	 * - Task: Transactions are shorter than the interrupt overhead, so poll from task context
+	 * - Inline poll: The entire request is shorter than the interrupt overhead, so complete it immediately
+	 *
+	 * This overrides the `Request::task` setting.
+	 *
+	 * @note Currently only implemented for the ESP8266
+	 */
+	void setAdaptiveCompletion(bool enable)
+	{
+		flags.adaptive = enable;
+	}
+
+	/**
+	 * @brief Get the average number of CPU cycles spent handling a transaction completion
+	 */
+	uint32_t getIsrCycles() const
+	{
+		return isrCycles;
+	}
+
+	/**
+	 * @brief Allow requests to be re-ordered to reduce configuration switching
+	 * @param window Number of queued requests to consider, 0 to disable
+	 *
+	 * Switching between devices with different clock, mode or pin set requires
+	 * hardware registers to be reloaded. When enabled, a queued request using the
+	 * current configuration is started in preference to one at the head of the queue.
+	 *
+	 * Requests for the same device are always executed in the order they were queued.
+	 * The request at the head of the queue is bypassed at most `window` times in succession.
+	 *
+	 * @note Currently only implemented for the ESP8266
+	 */
+	void setReorderWindow(uint8_t window)
+	{
+		reorderWindow = window;
+	}
+
+	uint8_t getReorderWindow() const
+	{
+		return reorderWindow;
+	}
+#endif
+
+	/**
+	 * @brief Get number of requests queued or in progress
+	 *
+	 * Re-queued and parked requests are counted once. Useful for balancing work across controllers.
+	 */
+	uint8_t getQueueDepth() const
+	{
+		return queueDepth;
+	}
+
 	void wait(Request& request);
 
 protected:
@@ -284,10 +379,24 @@ private:
 
 	static void updateConfig(Device& dev);
 
+	void queueParkTimer();
+	void serviceParked();
+	void releaseParked();
+	void deferRequest(Request& request);
+	void queueDeferred();
+
 	void queueTask();
 	void executeTask();
 	void startRequest();
+#ifdef ARCH_ESP32
+	void fillQueue();
+	bool queueTransaction();
+	void verifyFailed(EspTransaction& et);
+#else
 	void nextTransaction();
+	bool isActiveConfig(const Request& req) const;
+	Request* reorderRequests(Request* head);
+#endif
 	static void isr(Controller* spi);
 	void transactionDone();
 
@@ -302,9 +411,13 @@ private:
 #endif
 	struct Flags {
 		bool initialised : 1;
+		bool parkTimerQueued : 1; ///< Task queued to set timer for parked requests
+		bool completing : 1;	  ///< Completion callbacks in progress, see deferRequest()
 #ifndef ARCH_ESP32
 		bool spi0ClockChanged : 1; ///< SPI0 clock MUX setting was changed for a transaction
 		bool taskQueued : 1;
+		bool adaptive : 1; ///< Select completion mode automatically
+		bool configValid : 1; ///< activeRegs reflect current hardware state
 #endif
 	};
 	Flags flags{};
@@ -322,11 +435,33 @@ private:
 		volatile uint8_t busy : 1;
 		uint8_t addrShift;	///< How many bits to shift address left
 		uint32_t addrCmdMask; ///< In SDI/SQI modes this is combined with address
+#ifdef ARCH_ESP32
+		Request* issue;		 ///< Request whose transactions are being queued
+		uint32_t transFlags; ///< Transaction flags for current request
+		uint8_t pending : 1; ///< Request has transactions still to be queued
+		uint8_t first : 1;   ///< Next transaction is the first for request
+#else
+		Request* mergeTail; ///< Final request combined into current burst
+#endif
 	};
 	Transaction trans{};
+	volatile uint8_t queueDepth{0}; ///< Requests queued or in progress
+	Request* parked{nullptr};		///< Requests waiting to be re-queued - see parkRequest()
+	Request* deferred{nullptr};		///< Requests executed from completion callbacks - see deferRequest()
+	SimpleTimer parkTimer;
+#ifndef ARCH_ESP32
+	uint32_t isrCycles{400}; ///< Running average of transaction completion handling time
+	Config::Regs activeRegs; ///< Register values for most recently started request
+	uint8_t reorderWindow{0};
+	uint8_t bypassCount{0}; ///< Number of times request at head of queue has been passed over
+#endif
 #ifdef ARCH_ESP32
-	EspTransaction* esp_trans{nullptr};
-	uint32_t dmaBuffer[hardwareBufferSize / sizeof(uint32_t)];
+	EspTransaction* esp_trans{nullptr}; ///< Ring of transaction slots
+	uint8_t transHead{0};				///< Oldest transaction in flight
+	uint8_t transCount{0};				///< Number of transactions in flight
+	uint8_t dmaBufferBusy{0};			///< Bitmask of bounce buffers in use
+	uint32_t dmaBuffer[dmaBufferCount][hardwareBufferSize / sizeof(uint32_t)];
+	portMUX_TYPE queueLock = portMUX_INITIALIZER_UNLOCKED; ///< Guards queue and transaction slots
 #endif
 };
 
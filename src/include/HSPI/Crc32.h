@@ -0,0 +1,41 @@
+/****
+ * Crc32.h
+ *
+ * Copyright 2021 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the HardwareSPI Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace HSPI
+{
+/**
+ * @brief Update a CRC32 (IEEE 802.3, as used by zlib) with a block of data
+ * @param crc Result from previous call, or 0 to start a new calculation
+ * @param data
+ * @param length Number of bytes
+ * @retval uint32_t Updated CRC
+ *
+ * Uses a slicing-by-4 table kernel, processing one 32-bit word per iteration.
+ * Tables occupy 4KB of RAM so this may be safely called from interrupt context.
+ *
+ * @ingroup hw_spi
+ */
+uint32_t crc32(uint32_t crc, const void* data, size_t length);
+
+} // namespace HSPI
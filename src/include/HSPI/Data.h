@@ -33,6 +33,7 @@ namespace HSPI
  * @brief Specifies a block incoming or outgoing data
  *
  * Data can be specified directly within `Data`, or as a buffer reference.
+ * Outgoing data may also be a repeating pattern of 1-4 bytes, stored directly.
  *
  * Command or address are stored in native byte order and rearranged according to the requested
  * byteOrder setting. Data is always sent and received LSB first (as stored in memory) so any re-ordering
@@ -52,6 +53,7 @@ struct Data {
 	};
 	uint16_t length : 15;   ///< Number of bytes of data
 	uint16_t isPointer : 1; ///< If set, data is referenced indirectly, otherwise it's stored directly
+	uint8_t patternLength;  ///< Length of repeating pattern when stored directly with length > 4
 
 	Data()
 	{
@@ -66,6 +68,7 @@ struct Data {
 		data32 = 0;
 		length = 0;
 		isPointer = 0;
+		patternLength = 0;
 	}
 
 	/**
@@ -85,6 +88,14 @@ struct Data {
 		return isPointer ? ptr : data;
 	}
 
+	/**
+	 * @brief Determine if data is a repeating pattern
+	 */
+	bool isPattern() const
+	{
+		return !isPointer && length > sizeof(data32);
+	}
+
 	/**
 	 * @name Set internal data value of 1-4 bytes
 	 * @note Data is sent LSB, MSB (native byte order)
@@ -122,6 +133,45 @@ struct Data {
 	}
 
 	/** @} */
+
+	/**
+	 * @brief Set to a repeating pattern
+	 * @param pattern Value to repeat, in native byte order
+	 * @param patternLength Number of bytes in pattern (1 - 4)
+	 * @param count Total number of bytes
+	 * @note Only supported for outgoing data
+	 *
+	 * If `count` is 4 or less the pattern is expanded so it's sent as ordinary stored data.
+	 */
+	__forceinline void setPattern(uint32_t pattern, uint8_t patternLength, uint16_t count)
+	{
+		data32 = pattern;
+		length = count;
+		isPointer = 0;
+		this->patternLength = (patternLength >= 1 && patternLength <= 4) ? patternLength : 4;
+		for(unsigned i = this->patternLength; i < count && i < sizeof(data); ++i) {
+			data[i] = data[i % this->patternLength];
+		}
+	}
+
+	/**
+	 * @brief Write pattern data into a word-aligned buffer
+	 * @param buffer Destination, will be filled to a whole number of words
+	 * @param offset Position of first byte within pattern data
+	 * @param length Number of bytes required
+	 * @note Controllers use this to fill hardware buffers directly
+	 */
+	void fillPattern(volatile uint32_t* buffer, unsigned offset, unsigned length) const;
+
+	/**
+	 * @brief Compare a word-aligned buffer against referenced data
+	 * @param offset Position within referenced data corresponding to buffer[0]
+	 * @param buffer Received data
+	 * @param length Number of bytes to compare
+	 * @retval unsigned Position of first mismatch relative to `offset`, or `length` if data matches
+	 * @note Controllers use this to verify incoming data directly from hardware buffers
+	 */
+	unsigned compare(unsigned offset, const volatile uint32_t* buffer, unsigned length) const;
 };
 
 } // namespace HSPI
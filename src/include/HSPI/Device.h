@@ -93,6 +93,17 @@ public:
 		return speed;
 	}
 
+	/**
+	 * @brief Change bus speed
+	 * @param clockSpeed Requested speed, the actual speed is returned by getSpeed()
+	 * @note Device must be idle, including any commands it has queued itself.
+	 * See MemoryDevice::waitCommands().
+	 */
+	bool setSpeed(uint32_t clockSpeed)
+	{
+		return controller.setSpeed(*this, clockSpeed);
+	}
+
 	/*
 	 * Byte ordering is consistent with processor, i.e. always LSB first, but bit ordering
 	 * is variable.
@@ -130,12 +141,15 @@ public:
 		return getSupportedIoModes()[mode];
 	}
 
+	/**
+	 * @brief Set IO mode for subsequent requests
+	 *
+	 * Each request takes the IO mode when it's executed, so requests already queued are unaffected
+	 * and there's no need to wait for them to complete.
+	 */
 	virtual bool setIoMode(IoMode mode)
 	{
-		if(ioMode != mode) {
-			ioMode = mode;
-			controller.configChanged(*this);
-		}
+		ioMode = mode;
 		return true;
 	}
 
@@ -144,6 +158,15 @@ public:
 		return ioMode;
 	}
 
+	/**
+	 * @brief Get IO mode to be used for a request
+	 * @note Only valid once request has been executed
+	 */
+	__forceinline IoMode getIoMode(const Request& req) const
+	{
+		return req.ioMode;
+	}
+
 	size_t getBitsPerClock() const
 	{
 		switch(ioMode) {
@@ -166,6 +189,9 @@ public:
 	void execute(Request& request)
 	{
 		request.device = this;
+		if(!request.overrideIoMode) {
+			request.ioMode = ioMode;
+		}
 		controller.execute(request);
 	}
 
@@ -0,0 +1,224 @@
+/****
+ * W25Q.h
+ *
+ * Copyright 2021 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the HardwareSPI Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#pragma once
+
+#include "../MemoryDevice.h"
+#include <Interrupts.h>
+
+namespace HSPI
+{
+namespace Flash
+{
+/**
+ * @brief W25Q-compatible SPI NOR flash
+ *
+ * Reads use the fast read command appropriate for the current IO mode: SPIHD, DUAL, DIO, QUAD or QIO.
+ *
+ * Program and erase operations run asynchronously using a single internal request.
+ * From its completion callback the request is re-queued for each step: write enable,
+ * program or erase command, then status reads until the device is no longer busy.
+ * Status reads are spaced by the poll interval, during which the request is parked by the controller
+ * so the bus is available to other devices and no CPU time is used.
+ * Programming is split into pages, with the next page set up as soon as the previous one has been issued.
+ *
+ * Status and erase commands always use single-bit transfers, regardless of IO mode.
+ * In QUAD and QIO modes pages are programmed using the quad input command.
+ *
+ * @note Addresses are 24 bits so devices larger than 16MB are limited to the first 16MB.
+ *
+ * @ingroup hw_spi
+ */
+class W25Q : public MemoryDevice
+{
+public:
+	static constexpr uint16_t pageSize{256};
+	static constexpr uint16_t sectorSize{4096};
+
+	struct Stats {
+		uint32_t pagesProgrammed;
+		uint32_t erases; ///< Sector, block or chip erase commands issued
+		uint32_t statusPolls;
+
+		void clear()
+		{
+			*this = {};
+		}
+	};
+
+	using MemoryDevice::MemoryDevice;
+
+	~W25Q()
+	{
+		wait();
+	}
+
+	/**
+	 * @brief Initialise device and read its size
+	 */
+	bool begin(PinSet pinSet, uint8_t chipSelect, uint32_t clockSpeed);
+
+	size_t getSize() const override
+	{
+		return size;
+	}
+
+	IoModes getSupportedIoModes() const override
+	{
+		return IoModes(IoMode::SPIHD | IoMode::DUAL | IoMode::DIO | IoMode::QUAD | IoMode::QIO);
+	}
+
+	/**
+	 * @brief Set IO mode for reads, enabling quad operation in device if required
+	 */
+	bool setIoMode(IoMode mode) override;
+
+	/**
+	 * @brief Read JEDEC ID (blocking)
+	 * @retval uint32_t Manufacturer ID in bits 16-23, memory type in 8-15 and capacity in 0-7
+	 */
+	uint32_t readId();
+
+	/**
+	 * @brief Read a status register (blocking)
+	 * @param cmd 0x05 for status register 1, 0x35 for 2, 0x15 for 3
+	 */
+	uint8_t readStatus(uint8_t cmd = 0x05);
+
+	/**
+	 * @brief Prepare a raw page program request
+	 * @note Device must already be write-enabled and data must not cross a page boundary.
+	 * Use `program()` instead.
+	 */
+	void prepareWrite(HSPI::Request& req, uint32_t address) override;
+
+	void prepareRead(HSPI::Request& req, uint32_t address) override;
+
+	/**
+	 * @brief Program data, which may span any number of pages
+	 * @param callback Invoked in task context on completion
+	 * @retval bool false if another operation is in progress or range is invalid
+	 * @note Data buffer must remain valid until completion
+	 */
+	bool program(uint32_t address, const void* data, size_t len, InterruptDelegate callback = nullptr);
+
+	/**
+	 * @brief Erase a range of sectors
+	 * @param address Must be sector-aligned
+	 * @param len Must be a multiple of sector size
+	 * @param callback Invoked in task context on completion
+	 * @retval bool false if another operation is in progress or range is invalid
+	 *
+	 * The largest possible block erase commands are used.
+	 */
+	bool erase(uint32_t address, size_t len, InterruptDelegate callback = nullptr);
+
+	/**
+	 * @brief Erase entire device
+	 */
+	bool eraseChip(InterruptDelegate callback = nullptr);
+
+	/**
+	 * @brief Set time between status reads while waiting for program or erase to complete
+	 * @param us Microseconds, 0 to poll continuously
+	 */
+	void setPollInterval(uint32_t us)
+	{
+		pollInterval = us;
+	}
+
+	uint32_t getPollInterval() const
+	{
+		return pollInterval;
+	}
+
+	/**
+	 * @brief Determine if a program or erase operation is in progress
+	 */
+	bool isBusy() const
+	{
+		return phase != Phase::idle;
+	}
+
+	using MemoryDevice::wait;
+
+	/**
+	 * @brief Block until any program or erase operation has completed
+	 */
+	void wait();
+
+	const Stats& getStats() const
+	{
+		return stats;
+	}
+
+	void clearStats()
+	{
+		stats.clear();
+	}
+
+protected:
+	bool canMergeRequests() const override
+	{
+		// Page program must not cross page boundaries
+		return false;
+	}
+
+private:
+	enum class Phase : uint8_t {
+		idle,
+		writeEnable,
+		command,
+		poll,
+	};
+
+	struct Operation {
+		const uint8_t* data;
+		uint32_t address;
+		uint32_t remaining;
+		uint8_t eraseCmd; ///< 0 for program
+	};
+
+	bool isQuad() const
+	{
+		auto mode = getIoMode();
+		return mode == IoMode::QUAD || mode == IoMode::QIO;
+	}
+
+	bool start(const Operation& operation, InterruptDelegate callback);
+	void setWriteEnable();
+	void setOperation();
+	void setPoll();
+	void complete();
+	void sendCommand(uint8_t cmd);
+	void waitReady();
+	static bool requestComplete(Request& request);
+
+	Request req;
+	Operation op{};
+	uint32_t size{0};
+	uint32_t pollInterval{100};
+	InterruptDelegate callback;
+	volatile Phase phase{Phase::idle};
+	volatile bool taskQueued{false};
+	Stats stats{};
+};
+
+} // namespace Flash
+} // namespace HSPI
@@ -0,0 +1,364 @@
+/****
+ * GenericMemory.h
+ *
+ * Copyright 2021 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the HardwareSPI Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#pragma once
+
+#include "MemoryDevice.h"
+#include <Interrupts.h>
+#include <Platform/System.h>
+#include <algorithm>
+
+namespace HSPI
+{
+/**
+ * @brief Describes the command set of a serial memory device
+ *
+ * Define these as `constexpr` so they can be used as template parameters for GenericMemory.
+ *
+ * @ingroup hw_spi
+ */
+struct MemoryDescriptor {
+	static constexpr unsigned maxModes{5};
+
+	/**
+	 * @brief Commands for one IO mode
+	 *
+	 * To switch modes, the exit command for the current mode (if any) is sent using that mode.
+	 * The enter command for the new mode (if any) is then sent in SPIHD mode.
+	 */
+	struct Mode {
+		IoMode ioMode;
+		uint8_t readCmd;   ///< Read command, 0 marks an unused entry
+		uint8_t readDummy; ///< Dummy clock cycles following read address
+		uint8_t writeCmd;
+		uint8_t enterCmd; ///< Command to switch device into this mode, 0 if none required
+		uint8_t exitCmd;  ///< Command to return device to SPI mode, 0 if none required
+	};
+
+	uint32_t size;		///< Capacity in bytes
+	uint8_t addrBits;   ///< Address bits for read/write commands
+	uint16_t pageSize;  ///< Bursts wrap at this boundary (a power of 2), 0 if they run through the entire array
+	uint16_t maxSelectTime; ///< Longest time CS may be held low in nanoseconds (e.g. tCEM), 0 if unlimited
+	uint8_t reset[2];   ///< Commands issued in SPIHD mode by `begin()`, 0 if unused
+	Mode modes[maxModes]; ///< Supported modes, which must include SPIHD
+
+	constexpr const Mode* findMode(IoMode ioMode) const
+	{
+		for(auto& mode : modes) {
+			if(mode.readCmd != 0 && mode.ioMode == ioMode) {
+				return &mode;
+			}
+		}
+		return nullptr;
+	}
+
+	constexpr IoModes getIoModes() const
+	{
+		uint16_t bits{0};
+		for(auto& mode : modes) {
+			if(mode.readCmd != 0) {
+				bits |= IoModes::bitVal(mode.ioMode);
+			}
+		}
+		return IoModes(bits);
+	}
+};
+
+/**
+ * @brief Memory device whose commands are defined by a MemoryDescriptor
+ * @tparam desc Descriptor for the device
+ *
+ * Commands and dummy cycles for the current IO mode are looked up when the mode is changed,
+ * so preparing a request costs no more than a hand-coded driver.
+ *
+ * Mode switch commands are queued as asynchronous requests, so changing mode doesn't wait for
+ * requests in progress. Each request uses the IO mode in effect when it was executed.
+ * The request preparation methods are `final` so calls made via this class (or a subclass) are not virtual.
+ *
+ * @ingroup hw_spi
+ */
+template <const MemoryDescriptor& desc> class GenericMemory : public MemoryDevice
+{
+public:
+	static_assert(desc.findMode(IoMode::SPIHD) != nullptr, "Descriptor must support SPIHD");
+
+	using MemoryDevice::MemoryDevice;
+
+	~GenericMemory()
+	{
+		waitCommands();
+	}
+
+	static constexpr const MemoryDescriptor& descriptor{desc};
+
+	size_t getSize() const final
+	{
+		return desc.size;
+	}
+
+	IoModes getSupportedIoModes() const final
+	{
+		return desc.getIoModes();
+	}
+
+	/**
+	 * @brief Configure the device into a known operating mode
+	 *
+	 * Exit commands are issued for every mode, then any reset commands, leaving the device in SPIHD mode.
+	 */
+	bool begin(PinSet pinSet, uint8_t chipSelect, uint32_t clockSpeed)
+	{
+		if(!beginAsync(pinSet, chipSelect, clockSpeed)) {
+			return false;
+		}
+
+		while(initStep != initDone) {
+			wait(initReq);
+		}
+		return true;
+	}
+
+	/**
+	 * @brief Configure the device without blocking
+	 * @param callback Invoked in task context when initialisation has completed
+	 * @retval bool false if device couldn't be started
+	 *
+	 * The sequence used by `begin()` is run using a single request, re-queued from its completion
+	 * callback for each command. Devices on separate controllers can therefore be initialised in parallel.
+	 * Further requests may be issued straight away as they're queued behind the sequence.
+	 */
+	bool beginAsync(PinSet pinSet, uint8_t chipSelect, uint32_t clockSpeed, InterruptDelegate callback = nullptr)
+	{
+		wait(initReq);
+		if(!MemoryDevice::begin(pinSet, chipSelect, clockSpeed)) {
+			return false;
+		}
+
+		setBitOrder(MSBFIRST);
+		setClockMode(ClockMode::mode0);
+		MemoryDevice::setIoMode(IoMode::SPIHD);
+		mode = desc.findMode(IoMode::SPIHD);
+		burstSpeed = 0;
+
+		initCallback = callback;
+		initStep = 0;
+		if(setInitStep()) {
+			initReq.setAsync(initStepComplete, this);
+			execute(initReq);
+		} else {
+			initComplete();
+		}
+
+		return true;
+	}
+
+	void waitCommands() final
+	{
+		wait(initReq);
+		for(auto& req : cmdReq) {
+			wait(req);
+		}
+	}
+
+	bool setIoMode(IoMode ioMode) final
+	{
+		if(ioMode == getIoMode()) {
+			return true;
+		}
+
+		auto newMode = desc.findMode(ioMode);
+		if(newMode == nullptr) {
+			debug_e("setIoMode(): Mode %u invalid", unsigned(ioMode));
+			return false;
+		}
+
+		if(mode->exitCmd != 0) {
+			queueCommand(getIoMode(), mode->exitCmd);
+		}
+		if(newMode->enterCmd != 0) {
+			queueCommand(IoMode::SPIHD, newMode->enterCmd);
+		}
+
+		mode = newMode;
+		burstSpeed = 0;
+		return MemoryDevice::setIoMode(ioMode);
+	}
+
+	void prepareWrite(HSPI::Request& req, uint32_t address) final
+	{
+		wait(req);
+		req.setCommand8(mode->writeCmd);
+		req.setAddress(address, desc.addrBits);
+		req.dummyLen = 0;
+		setBurstLimits(req);
+	}
+
+	void prepareRead(HSPI::Request& req, uint32_t address) final
+	{
+		wait(req);
+		req.setCommand8(mode->readCmd);
+		req.setAddress(address, desc.addrBits);
+		req.dummyLen = mode->readDummy;
+		setBurstLimits(req);
+	}
+
+protected:
+	void sendCommand(uint8_t cmd)
+	{
+		Request req;
+		req.setCommand8(cmd);
+		execute(req);
+	}
+
+	/**
+	 * @brief Queue a command without waiting for it to complete
+	 * @param ioMode Mode to use for the command, regardless of device setting
+	 * @param cmd
+	 *
+	 * A small pool of requests is used, so this only blocks if they're all still in progress.
+	 */
+	void queueCommand(IoMode ioMode, uint8_t cmd)
+	{
+		execute(getCommandRequest(ioMode, cmd));
+	}
+
+	/**
+	 * @brief Queue a command with one data byte
+	 */
+	void queueCommand(IoMode ioMode, uint8_t cmd, uint8_t data)
+	{
+		auto& req = getCommandRequest(ioMode, cmd);
+		req.out.set8(data);
+		execute(req);
+	}
+
+	/**
+	 * @brief Boundary at which the device currently wraps bursts
+	 *
+	 * Devices with a configurable wrap length should update this when it's changed.
+	 */
+	uint16_t pageSize{desc.pageSize};
+
+private:
+	static constexpr uint8_t initDone{0xff};
+
+	/*
+	 * Set up request for next initialisation command: exit commands, then reset commands
+	 */
+	bool IRAM_ATTR setInitStep()
+	{
+		while(initStep < MemoryDescriptor::maxModes) {
+			auto& m = desc.modes[initStep++];
+			if(m.readCmd != 0 && m.exitCmd != 0) {
+				initReq.setIoMode(m.ioMode);
+				initReq.setCommand8(m.exitCmd);
+				return true;
+			}
+		}
+		while(initStep < MemoryDescriptor::maxModes + sizeof(desc.reset)) {
+			auto cmd = desc.reset[initStep++ - MemoryDescriptor::maxModes];
+			if(cmd != 0) {
+				initReq.setIoMode(IoMode::SPIHD);
+				initReq.setCommand8(cmd);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	static bool IRAM_ATTR initStepComplete(Request& request)
+	{
+		auto self = static_cast<GenericMemory*>(request.param);
+		if(self->setInitStep()) {
+			return false;
+		}
+		self->initComplete();
+		return true;
+	}
+
+	void IRAM_ATTR initComplete()
+	{
+		initStep = initDone;
+		if(initCallback) {
+			System.queueCallback(
+				[](void* param) {
+					auto self = static_cast<GenericMemory*>(param);
+					auto cb = self->initCallback;
+					self->initCallback = nullptr;
+					cb();
+				},
+				this);
+		}
+	}
+
+	Request& getCommandRequest(IoMode ioMode, uint8_t cmd)
+	{
+		auto& req = cmdReq[cmdIndex];
+		cmdIndex = (cmdIndex + 1) % commandRequests;
+		wait(req);
+		req.setIoMode(ioMode);
+		req.setCommand8(cmd);
+		req.out.clear();
+		req.setAsync();
+		return req;
+	}
+
+	/*
+	 * The controller splits requests into transactions which don't cross a page boundary
+	 * and which complete within `maxSelectTime`, so requests may be any length and can be merged.
+	 */
+	void setBurstLimits(HSPI::Request& req)
+	{
+		req.pageSize = pageSize;
+		req.wrap = false;
+		if(desc.maxSelectTime == 0) {
+			req.maxTransactionSize = 0;
+			return;
+		}
+		if(getSpeed() != burstSpeed) {
+			updateMaxBurst();
+		}
+		req.maxTransactionSize = maxBurst;
+	}
+
+	void updateMaxBurst()
+	{
+		burstSpeed = getSpeed();
+		auto ioMode = getIoMode();
+		uint32_t clocks = uint64_t(burstSpeed) * desc.maxSelectTime / 1000000000U;
+		// Allow for the longer of the read and write headers
+		auto overhead = getTransactionClocks(ioMode, 8, desc.addrBits, mode->readDummy, 0);
+		unsigned len = (clocks > overhead) ? (clocks - overhead) * getIoModeInfo(ioMode).dataBits / 8 : 0;
+		// At very low clock speeds the limit can't be met at all, so don't split transfers
+		maxBurst = std::min(len, 0x7fffU);
+	}
+
+	static constexpr uint8_t commandRequests{4};
+
+	const MemoryDescriptor::Mode* mode{desc.findMode(IoMode::SPIHD)};
+	Request cmdReq[commandRequests];
+	uint8_t cmdIndex{0};
+	Request initReq;
+	InterruptDelegate initCallback;
+	volatile uint8_t initStep{initDone};
+	uint32_t burstSpeed{0}; ///< Clock speed for which `maxBurst` was calculated
+	uint16_t maxBurst{0};   ///< Largest transaction which completes within `maxSelectTime`, 0 for no limit
+};
+
+} // namespace HSPI
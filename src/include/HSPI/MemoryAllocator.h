@@ -0,0 +1,200 @@
+/****
+ * MemoryAllocator.h
+ *
+ * Copyright 2021 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the HardwareSPI Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#pragma once
+
+#include "MemoryDevice.h"
+
+namespace HSPI
+{
+/**
+ * @brief Allocate blocks of memory within the address space of a MemoryDevice
+ *
+ * Uses a two-level segregated fit (TLSF) scheme so allocation and release take constant time.
+ *
+ * Block information is kept in a table of descriptors in internal RAM, so the device itself is never accessed.
+ * Each allocated or free block uses one descriptor. If the table is exhausted then blocks are no
+ * longer split, so an allocation may be given more space than requested.
+ *
+ * Allocations are identified by handle, which may be converted to a device address.
+ *
+ * @ingroup hw_spi
+ */
+class MemoryAllocator
+{
+public:
+	using Handle = uint16_t;
+	static constexpr Handle invalidHandle{0xffff};
+
+	struct Stats {
+		uint32_t totalSize;		  ///< Size of managed region
+		uint32_t usedSize;		  ///< Bytes allocated, including alignment
+		uint32_t largestFree;	 ///< Size of largest free block
+		uint16_t usedBlocks;	  ///< Number of allocated blocks
+		uint16_t freeBlocks;	  ///< Number of free blocks
+		uint16_t spareDescriptors; ///< Block descriptors available
+		uint32_t allocCount;	  ///< Successful allocations
+		uint32_t failCount;		  ///< Failed allocations
+		uint32_t freeCount;		  ///< Blocks released
+		uint32_t maxAllocCycles;  ///< Slowest allocation, in CPU cycles
+		uint32_t totalAllocCycles; ///< Sum of CPU cycles for all allocations
+		uint32_t maxFreeCycles;	///< Slowest release, in CPU cycles
+
+		/**
+		 * @brief Get external fragmentation as a percentage
+		 *
+		 * 0 means all free space is in one block, approaching 100 means free space is split
+		 * into many small blocks.
+		 */
+		unsigned getFragmentation() const
+		{
+			auto freeSize = totalSize - usedSize;
+			return (freeSize == 0) ? 0 : 100 - unsigned(uint64_t(largestFree) * 100 / freeSize);
+		}
+	};
+
+	/**
+	 * @param device
+	 * @param maxBlocks Number of block descriptors to allocate
+	 * @param alignment Allocation granularity in bytes, must be a power of 2
+	 */
+	MemoryAllocator(MemoryDevice& device, uint16_t maxBlocks = 256, uint16_t alignment = 16);
+
+	~MemoryAllocator()
+	{
+		delete[] blocks;
+	}
+
+	/**
+	 * @brief Initialise the allocator
+	 * @param start Device address of region to manage
+	 * @param size Size of region, 0 to use remainder of device
+	 * @retval bool false if region is invalid or descriptors could not be allocated
+	 *
+	 * Any existing allocations are discarded.
+	 */
+	bool begin(uint32_t start = 0, uint32_t size = 0);
+
+	/**
+	 * @brief Allocate a block
+	 * @param size Number of bytes required
+	 * @retval Handle invalidHandle if there's insufficient space
+	 */
+	Handle allocate(size_t size);
+
+	/**
+	 * @brief Release a block
+	 */
+	void free(Handle handle);
+
+	/**
+	 * @brief Get device address for a block
+	 */
+	uint32_t getAddress(Handle handle) const
+	{
+		return blocks[handle].address;
+	}
+
+	/**
+	 * @brief Get usable size of a block
+	 */
+	size_t getSize(Handle handle) const
+	{
+		return blocks[handle].size;
+	}
+
+	MemoryDevice& getDevice() const
+	{
+		return device;
+	}
+
+	/**
+	 * @brief Write data into a block (blocking)
+	 */
+	void write(Handle handle, uint32_t offset, const void* data, size_t len)
+	{
+		device.write(getAddress(handle) + offset, data, len);
+	}
+
+	/**
+	 * @brief Read data from a block (blocking)
+	 */
+	void read(Handle handle, uint32_t offset, void* buffer, size_t len)
+	{
+		device.read(getAddress(handle) + offset, buffer, len);
+	}
+
+	/**
+	 * @brief Get current statistics
+	 * @note Walks the block table so takes time proportional to the number of blocks
+	 */
+	Stats getStats() const;
+
+	void clearStats()
+	{
+		counters = {};
+	}
+
+private:
+	static constexpr unsigned slLog2{4};
+	static constexpr unsigned slCount{1U << slLog2};
+	static constexpr unsigned flCount{32 - slLog2 + 1};
+	static constexpr uint16_t none{0xffff};
+
+	struct Block {
+		uint32_t address;
+		uint32_t size;
+		uint16_t prevPhys;
+		uint16_t nextPhys;
+		uint16_t prevFree; ///< Free list or spare descriptor chain
+		uint16_t nextFree;
+		bool isFree;
+		bool inUse; ///< Descriptor is in use
+	};
+
+	struct Counters {
+		uint32_t allocCount;
+		uint32_t failCount;
+		uint32_t freeCount;
+		uint32_t maxAllocCycles;
+		uint32_t totalAllocCycles;
+		uint32_t maxFreeCycles;
+	};
+
+	void mapping(uint32_t size, unsigned& fl, unsigned& sl) const;
+	uint16_t findFree(uint32_t size);
+	void insertFree(uint16_t index);
+	void removeFree(uint16_t index);
+	uint16_t newDescriptor();
+	void releaseDescriptor(uint16_t index);
+	void merge(uint16_t index, uint16_t next);
+
+	MemoryDevice& device;
+	Block* blocks{nullptr};
+	uint16_t maxBlocks;
+	uint8_t alignShift{0};
+	uint16_t spare{none}; ///< Chain of unused descriptors
+	uint32_t totalSize{0};
+	uint32_t flBitmap{0};
+	uint16_t slBitmap[flCount]{};
+	uint16_t freeLists[flCount][slCount];
+	Counters counters{};
+};
+
+} // namespace HSPI
@@ -25,6 +25,29 @@
 
 namespace HSPI
 {
+/**
+ * @brief Request for transferring a rectangular region, such as part of a framebuffer
+ *
+ * The request is re-queued from its completion callback for each row, so the whole region
+ * is transferred without task involvement and the completion callback is invoked once.
+ * Where rows are contiguous in both device and RAM they are transferred together.
+ *
+ * Fields are managed by MemoryDevice::writeRect() and MemoryDevice::readRect().
+ *
+ * @ingroup hw_spi
+ */
+struct RectRequest : public Request {
+	uint8_t* buffer{nullptr};	///< RAM address of current segment
+	uint32_t deviceStride{0};	///< Bytes between rows in device memory
+	uint16_t bufferStride{0};	///< Bytes between rows in RAM
+	uint16_t rowLength{0};		 ///< Bytes per row
+	uint16_t rowsRemaining{0};   ///< Rows not yet started
+	uint16_t rowsPerSegment{0};  ///< Maximum rows in each transfer
+	uint16_t segmentRows{0};	 ///< Rows in current transfer
+	bool isWrite{false};
+	Callback rectCallback{nullptr}; ///< Invoked when all rows have completed
+};
+
 /**
  * @brief Base class for read/write addressable devices
  * @ingroup hw_spi
@@ -34,6 +57,60 @@ class MemoryDevice : public Device
 public:
 	using Device::Device;
 
+	/**
+	 * @brief Maximum length of a single fill request
+	 *
+	 * A multiple of all supported pattern lengths so the pattern is continuous across requests.
+	 */
+	static constexpr size_t maxFillSize{32760};
+
+	/**
+	 * @brief Maximum length of a single verify request
+	 */
+	static constexpr size_t maxVerifySize{0x7fff};
+
+	/**
+	 * @brief Wait for commands the device has queued itself, such as IO mode switches
+	 *
+	 * Call before setSpeed(), which requires the device to be idle, so queued commands
+	 * aren't sent at the new speed.
+	 */
+	virtual void waitCommands()
+	{
+	}
+
+	/**
+	 * @brief Parameters for probe()
+	 */
+	struct ProbeSettings {
+		uint32_t address{0};		///< Start of test area. Content is overwritten.
+		uint16_t length{1024};		///< Size of test area
+		uint8_t iterations{4};		///< Number of reads to time for each setting
+		uint32_t maxSpeed{80000000}; ///< Clock speeds tried are maxSpeed / n
+		uint32_t minSpeed{1000000};
+	};
+
+	/**
+	 * @brief Fastest reliable setting found by probe()
+	 *
+	 * Plain data so it can be stored and passed to applyProbeResult() on subsequent boots.
+	 */
+	struct ProbeResult {
+		uint32_t deviceSize;	 ///< Checked to ensure result applies to the device
+		uint32_t clockSpeed;	 ///< Actual bus speed
+		uint32_t bytesPerSecond; ///< Measured read throughput
+		IoMode ioMode;
+	};
+
+	/**
+	 * @brief Outcome of tune()
+	 */
+	enum class TuneResult {
+		unchanged, ///< Cached setting verified and applied
+		updated,   ///< New setting found by probe(), cache updated and should be saved
+		failed,	///< No working setting found, device left at its original setting
+	};
+
 	/**
 	  * @name Prepare a write request
 	  * @{
@@ -56,9 +133,27 @@ public:
 	void prepareWrite(HSPI::Request& req, uint32_t address, const void* data, size_t len)
 	{
 		prepareWrite(req, address);
+		req.merge = canMergeRequests();
+		req.verify = false;
 		req.out.set(data, len);
 		req.in.clear();
 	}
+
+	/**
+	 * @param req
+	 * @param address
+	 * @param len Number of bytes to write, limited to `maxFillSize`
+	 * @param pattern Value to repeat, in native byte order
+	 * @param patternLength Number of bytes in pattern (1 - 4)
+	 */
+	void prepareFill(HSPI::Request& req, uint32_t address, size_t len, uint32_t pattern, uint8_t patternLength)
+	{
+		prepareWrite(req, address);
+		req.merge = false;
+		req.verify = false;
+		req.out.setPattern(pattern, patternLength, len);
+		req.in.clear();
+	}
 	/** @} */
 
 	/**
@@ -134,6 +229,53 @@ public:
 		execute(req);
 	}
 
+	/**
+	 * @brief Fill a region with a repeating pattern (blocking)
+	 * @param address
+	 * @param len Number of bytes to write
+	 * @param pattern Value to repeat, in native byte order
+	 * @param patternLength Number of bytes in pattern (1 - 4)
+	 *
+	 * The controller generates pattern data directly into its hardware buffers,
+	 * so no RAM buffer is required. Two requests are used so one is always queued.
+	 */
+	void fill(uint32_t address, size_t len, uint32_t pattern, uint8_t patternLength = 1)
+	{
+		Request reqs[2];
+		unsigned i{0};
+		while(len != 0) {
+			auto& req = reqs[i];
+			auto count = std::min(len, maxFillSize);
+			wait(req);
+			prepareFill(req, address, count, pattern, patternLength);
+			req.setAsync();
+			execute(req);
+			address += count;
+			len -= count;
+			i ^= 1;
+		}
+		wait(reqs[0]);
+		wait(reqs[1]);
+	}
+
+	/**
+	 * @brief Fill a region with a repeating pattern
+	 * @param req
+	 * @param address
+	 * @param len Number of bytes to write, limited to `maxFillSize`
+	 * @param pattern Value to repeat, in native byte order
+	 * @param patternLength Number of bytes in pattern (1 - 4)
+	 * @param callback
+	 * @param param
+	 */
+	void fill(Request& req, uint32_t address, size_t len, uint32_t pattern, uint8_t patternLength,
+			  Callback callback = nullptr, void* param = nullptr)
+	{
+		prepareFill(req, address, std::min(len, maxFillSize), pattern, patternLength);
+		req.setAsync(callback, param);
+		execute(req);
+	}
+
 	void writeWord(Request& req, uint32_t address, uint32_t value, unsigned byteCount)
 	{
 		prepareWrite(req, address);
@@ -162,10 +304,32 @@ public:
 	void prepareRead(HSPI::Request& req, uint32_t address, void* buffer, size_t len)
 	{
 		prepareRead(req, address);
+		req.merge = canMergeRequests();
+		req.verify = false;
 		req.out.clear();
 		req.in.set(buffer, len);
 	}
 
+	/**
+	 * @brief Prepare a request to compare device content with a block of data
+	 * @param req
+	 * @param address
+	 * @param expected Data to compare against, must remain valid until the request completes
+	 * @param len Limited to `maxVerifySize`
+	 *
+	 * The controller compares incoming data as each transaction completes,
+	 * so no read buffer is required. If a mismatch is found the request stops early and
+	 * `req.in.length` is set to the offset of the first mismatching byte.
+	 */
+	void prepareVerify(HSPI::Request& req, uint32_t address, const void* expected, size_t len)
+	{
+		prepareRead(req, address);
+		req.merge = false;
+		req.verify = true;
+		req.out.clear();
+		req.in.set(expected, std::min(len, maxVerifySize));
+	}
+
 	/** @} */
 
 	/**
@@ -225,6 +389,165 @@ public:
 		req.setAsync(callback, param);
 		execute(req);
 	}
+
+	/**
+	 * @brief Compare device content with a block of data (blocking)
+	 * @param address
+	 * @param expected
+	 * @param len
+	 * @retval int Offset of first mismatching byte, -1 if all data matches
+	 */
+	int verify(uint32_t address, const void* expected, size_t len)
+	{
+		Request req;
+		auto data = static_cast<const uint8_t*>(expected);
+		size_t offset{0};
+		while(offset < len) {
+			auto count = std::min(len - offset, maxVerifySize);
+			prepareVerify(req, address + offset, data + offset, count);
+			execute(req);
+			if(req.in.length != count) {
+				return offset + req.in.length;
+			}
+			offset += count;
+		}
+		return -1;
+	}
+
+	/**
+	 * @brief Compare device content with a block of data
+	 * @param req On completion, `req.in.length` is less than `len` if a mismatch was found
+	 * @param address
+	 * @param expected
+	 * @param len Limited to `maxVerifySize`
+	 * @param callback
+	 * @param param
+	 */
+	void verify(Request& req, uint32_t address, const void* expected, size_t len, Callback callback = nullptr,
+				void* param = nullptr)
+	{
+		prepareVerify(req, address, expected, len);
+		req.setAsync(callback, param);
+		execute(req);
+	}
+
+	/**
+	 * @name Rectangle transfers
+	 *
+	 * Transfer a number of equal-length rows which are regularly spaced in device memory
+	 * and in RAM, such as a sub-region of a framebuffer.
+	 *
+	 * @param req Request to use
+	 * @param address Device address of first row
+	 * @param deviceStride Bytes between rows in device memory
+	 * @param buffer Address of first row in RAM
+	 * @param bufferStride Bytes between rows in RAM
+	 * @param rowLength Bytes per row, up to 32767
+	 * @param rows Number of rows
+	 * @param callback Invoked once when all rows have completed
+	 * @param param
+	 * @retval bool false if `rowLength` or `rows` is 0, or `rowLength` exceeds 32767, in which case the
+	 * request isn't started and the callback isn't invoked
+	 *
+	 * @{
+	 */
+
+	bool writeRect(RectRequest& req, uint32_t address, uint32_t deviceStride, const void* data, uint16_t bufferStride,
+				   uint16_t rowLength, uint16_t rows, Callback callback = nullptr, void* param = nullptr)
+	{
+		return startRect(req, true, address, deviceStride, const_cast<void*>(data), bufferStride, rowLength, rows, callback,
+				  param);
+	}
+
+	void writeRect(uint32_t address, uint32_t deviceStride, const void* data, uint16_t bufferStride,
+				   uint16_t rowLength, uint16_t rows)
+	{
+		RectRequest req;
+		writeRect(req, address, deviceStride, data, bufferStride, rowLength, rows);
+		wait(req);
+	}
+
+	bool readRect(RectRequest& req, uint32_t address, uint32_t deviceStride, void* buffer, uint16_t bufferStride,
+				  uint16_t rowLength, uint16_t rows, Callback callback = nullptr, void* param = nullptr)
+	{
+		return startRect(req, false, address, deviceStride, buffer, bufferStride, rowLength, rows, callback, param);
+	}
+
+	void readRect(uint32_t address, uint32_t deviceStride, void* buffer, uint16_t bufferStride, uint16_t rowLength,
+				  uint16_t rows)
+	{
+		RectRequest req;
+		readRect(req, address, deviceStride, buffer, bufferStride, rowLength, rows);
+		wait(req);
+	}
+
+	/** @} */
+
+	/**
+	 * @name Performance tuning
+	 *
+	 * Call after `begin()`, which should leave the device in a known mode at a safe clock speed.
+	 * Mode switching is always done at that speed.
+	 *
+	 * @{
+	 */
+
+	/**
+	 * @brief Find the fastest reliable IO mode and clock speed
+	 * @param result On success, the selected setting
+	 * @param settings
+	 * @retval bool false if no setting passed, in which case the original setting is restored
+	 *
+	 * For each supported IO mode, clock speed is reduced from `maxSpeed` in steps until
+	 * a test pattern can be written and verified. The read throughput for that speed is then measured.
+	 * The setting giving the highest throughput is selected.
+	 */
+	bool probe(ProbeResult& result, const ProbeSettings& settings);
+
+	bool probe(ProbeResult& result)
+	{
+		return probe(result, ProbeSettings{});
+	}
+
+	/**
+	 * @brief Apply a setting obtained from probe()
+	 * @retval bool false if result isn't valid for this device
+	 */
+	bool applyProbeResult(const ProbeResult& result);
+
+	/**
+	 * @brief Apply cached result, running probe() if it isn't valid or fails verification
+	 * @param cache Result from a previous call, updated if a probe is run
+	 * @param settings
+	 * @retval TuneResult
+	 */
+	TuneResult tune(ProbeResult& cache, const ProbeSettings& settings);
+
+	TuneResult tune(ProbeResult& cache)
+	{
+		return tune(cache, ProbeSettings{});
+	}
+
+	/** @} */
+
+protected:
+	/**
+	 * @brief Determine whether requests for adjacent blocks may be combined into a single burst
+	 *
+	 * Used to set `Request::merge` for requests prepared with a data buffer.
+	 * Devices which don't support sequential access across the whole address range should return false.
+	 */
+	virtual bool canMergeRequests() const
+	{
+		return true;
+	}
+
+private:
+	bool checkPattern(const ProbeSettings& settings, uint8_t* buffer, uint32_t seed);
+	bool changeSpeed(uint32_t clockSpeed);
+	bool startRect(RectRequest& req, bool isWrite, uint32_t address, uint32_t deviceStride, void* buffer,
+				   uint16_t bufferStride, uint16_t rowLength, uint16_t rows, Callback callback, void* param);
+	static bool rectComplete(Request& request);
 };
 
 } // namespace HSPI
@@ -0,0 +1,240 @@
+/****
+ * MemoryLog.h
+ *
+ * Copyright 2021 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the HardwareSPI Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#pragma once
+
+#include "MemoryDevice.h"
+#include <Delegate.h>
+#include <Interrupts.h>
+
+namespace HSPI
+{
+/**
+ * @brief Append-only record log stored in a memory device region
+ *
+ * Records are appended to a RAM staging buffer. All records appended before the next task
+ * cycle (or until the buffer fills) form a group, which is written to the device with a single
+ * asynchronous request. A second staging buffer accepts new records while the write is in progress.
+ *
+ * Each record is given a sequence number. When a group has been written the commit callback
+ * is invoked with the sequence number of its last record; groups always complete in order.
+ *
+ * The log content may be replayed, or compacted by discarding unwanted records.
+ * Both run as background tasks, reading the log in buffer-sized chunks.
+ *
+ * @note Methods must be called from task context
+ *
+ * @ingroup hw_spi
+ */
+class MemoryLog
+{
+public:
+	/**
+	 * @brief Called when a group of records has been written
+	 * @param sequence Sequence number of last record in the group
+	 */
+	using CommitDelegate = Delegate<void(uint32_t sequence)>;
+
+	/**
+	 * @brief Called for each record during replay
+	 */
+	using ReplayDelegate = Delegate<void(const uint8_t* data, uint16_t length)>;
+
+	/**
+	 * @brief Called for each record during compaction
+	 * @retval bool true to keep the record, false to discard it
+	 */
+	using CompactDelegate = Delegate<bool(const uint8_t* data, uint16_t length)>;
+
+	struct Stats {
+		uint32_t records;		 ///< Records appended
+		uint32_t groups;		 ///< Group writes issued
+		uint32_t bytesWritten;   ///< Bytes written by group commits, including record headers
+		uint32_t appendFailures; ///< Records rejected because log or staging buffers were full
+		uint32_t recordsDropped; ///< Records discarded by compaction
+
+		void clear()
+		{
+			*this = {};
+		}
+	};
+
+	/**
+	 * @param device
+	 * @param baseAddress Start of device region
+	 * @param size Size of device region
+	 * @param bufferSize Size of each RAM buffer, which limits record size
+	 */
+	MemoryLog(MemoryDevice& device, uint32_t baseAddress, uint32_t size, uint16_t bufferSize = 1024)
+		: device(device), baseAddress(baseAddress), size(size), bufferSize(std::min(bufferSize, uint16_t(0x7fff)))
+	{
+	}
+
+	~MemoryLog()
+	{
+		end();
+	}
+
+	/**
+	 * @brief Allocate buffers and empty the log
+	 */
+	bool begin();
+
+	/**
+	 * @brief Wait for outstanding writes and release buffers
+	 *
+	 * Records which have not been committed are discarded.
+	 */
+	void end();
+
+	void onCommit(CommitDelegate delegate)
+	{
+		commitDelegate = delegate;
+	}
+
+	/**
+	 * @brief Add a record to the log
+	 * @retval uint32_t Sequence number for the record, 0 if the log or staging buffers are full
+	 */
+	uint32_t append(const void* data, uint16_t length);
+
+	/**
+	 * @brief Write staged records and wait for completion
+	 *
+	 * Normally groups are committed automatically. This blocks until all records appended
+	 * so far have been written and their commit callbacks invoked.
+	 */
+	void flush();
+
+	/**
+	 * @brief Read all written records in the background
+	 * @param recordCallback Invoked in task context for each record
+	 * @param doneCallback Invoked when replay has completed
+	 * @retval bool false if a replay or compaction is already in progress
+	 */
+	bool replay(ReplayDelegate recordCallback, InterruptDelegate doneCallback);
+
+	/**
+	 * @brief Remove unwanted records in the background
+	 * @param filter Invoked in task context for each record
+	 * @param doneCallback Invoked when compaction has completed
+	 * @retval bool false if a replay or compaction is already in progress
+	 *
+	 * Records appended during compaction are held in the staging buffers and written once it has completed.
+	 */
+	bool compact(CompactDelegate filter, InterruptDelegate doneCallback);
+
+	bool isScanning() const
+	{
+		return scanState != ScanState::idle;
+	}
+
+	/**
+	 * @brief Get sequence number of last record written to the device
+	 */
+	uint32_t getCommittedSequence() const
+	{
+		return committedSequence;
+	}
+
+	/**
+	 * @brief Number of bytes written or being written to the device
+	 */
+	uint32_t getUsed() const
+	{
+		return endOffset;
+	}
+
+	uint32_t getSize() const
+	{
+		return size;
+	}
+
+	const Stats& getStats() const
+	{
+		return stats;
+	}
+
+	void clearStats()
+	{
+		stats.clear();
+	}
+
+private:
+	static constexpr unsigned groupCount{2};
+
+	/*
+	 * Stored before each record
+	 */
+	struct Header {
+		uint16_t length;
+		uint16_t check; ///< Inverse of length
+	};
+
+	struct Group {
+		Request req;
+		uint8_t* data;
+		uint16_t length;
+		uint32_t lastSequence;
+		bool writing;
+	};
+
+	enum class ScanState {
+		idle,
+		reading,
+		writing,
+	};
+
+	void queueTask();
+	void task();
+	bool startWrite();
+	void checkCommits();
+	bool startScan();
+	void readChunk();
+	void processChunk();
+	void scanComplete();
+	static bool requestComplete(Request& req);
+
+	MemoryDevice& device;
+	uint8_t* buffer{nullptr};
+	uint32_t baseAddress;
+	uint32_t size;
+	uint16_t bufferSize;
+	Group groups[groupCount];
+	uint8_t groupIndex{0};  ///< Group accepting new records
+	uint8_t commitIndex{0}; ///< Oldest group being written
+	uint32_t endOffset{0};  ///< Where next group will be written
+	uint32_t nextSequence{1};
+	uint32_t committedSequence{0};
+	CommitDelegate commitDelegate;
+	volatile bool taskQueued{false};
+	// Replay and compaction
+	Request scanReq;
+	ScanState scanState{ScanState::idle};
+	uint32_t scanOffset{0};
+	uint32_t scanEnd{0};
+	uint16_t scanLength{0};
+	uint32_t compactOffset{0};
+	ReplayDelegate replayDelegate;
+	CompactDelegate compactDelegate;
+	InterruptDelegate doneCallback;
+	Stats stats{};
+};
+
+} // namespace HSPI
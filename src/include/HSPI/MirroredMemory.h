@@ -0,0 +1,74 @@
+/****
+ * MirroredMemory.h
+ *
+ * Copyright 2021 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the HardwareSPI Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#pragma once
+
+#include "CompositeMemory.h"
+
+namespace HSPI
+{
+/**
+ * @brief Keep identical copies of data on several memory devices
+ *
+ * Writes go to all members. Reads are served by the member(s) whose controller has the fewest
+ * outstanding requests.
+ *
+ * Reads of at least `splitThreshold` bytes are divided between members, with each member's share
+ * weighted inversely by its current queue depth. Where members are attached to separate controllers
+ * the parts are transferred concurrently.
+ *
+ * @ingroup hw_spi
+ */
+class MirroredMemory : public CompositeMemory
+{
+public:
+	static constexpr uint16_t maxSegmentSize{0x4000};
+
+	/**
+	 * @param splitThreshold Reads of this size or larger are shared between members
+	 */
+	MirroredMemory(size_t splitThreshold = 1024) : splitThreshold(splitThreshold)
+	{
+	}
+
+	void setSplitThreshold(size_t value)
+	{
+		splitThreshold = value;
+	}
+
+	size_t getSplitThreshold() const
+	{
+		return splitThreshold;
+	}
+
+	/**
+	 * @brief Size is limited by the smallest member
+	 */
+	size_t getSize() const override;
+
+protected:
+	void startOperation() override;
+	bool getSegment(Member& member, Segment& segment) override;
+
+private:
+	size_t splitThreshold;
+	uint8_t nextRead{0}; ///< Used to distribute small reads between equally loaded members
+};
+
+} // namespace HSPI
@@ -0,0 +1,188 @@
+/****
+ * PagedMemory.h
+ *
+ * Copyright 2021 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the HardwareSPI Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#pragma once
+
+#include "MemoryDevice.h"
+
+namespace HSPI
+{
+/**
+ * @brief Access a memory device through a small cache of pages held in internal RAM
+ *
+ * The device region is divided into fixed-size pages. A page is made available by pinning it,
+ * which reads it into a free cache slot if necessary (a page fault). Pinned pages stay resident
+ * until unpinned. When a slot is needed, the least-recently used unpinned page is evicted,
+ * preferring clean pages.
+ *
+ * Dirty pages are written back in batches: all outstanding writes are queued together so
+ * they run back-to-back on the bus.
+ *
+ * Pages expected to be needed soon may be prefetched, which starts an asynchronous read
+ * into a free slot without blocking.
+ *
+ * @note All methods must be called from task context
+ *
+ * @ingroup hw_spi
+ */
+class PagedMemory
+{
+public:
+	struct Stats {
+		uint32_t hits;		   ///< Page found in cache
+		uint32_t misses;	   ///< Page read from device on demand
+		uint32_t prefetches;   ///< Asynchronous page reads started
+		uint32_t prefetchHits; ///< Hits on pages which were prefetched
+		uint32_t evictions;	///< Pages discarded from cache
+		uint32_t writeBacks;   ///< Dirty pages written to device
+
+		void clear()
+		{
+			*this = {};
+		}
+	};
+
+	/**
+	 * @param device
+	 * @param pageSize Bytes per page, up to 32767
+	 * @param cacheSize Number of pages held in RAM
+	 * @param baseAddress Device address of first page
+	 */
+	PagedMemory(MemoryDevice& device, uint16_t pageSize = 512, uint8_t cacheSize = 8, uint32_t baseAddress = 0)
+		: device(device), pageSize(std::min(pageSize, uint16_t(0x7fff))), cacheSize(cacheSize),
+		  baseAddress(baseAddress)
+	{
+	}
+
+	~PagedMemory()
+	{
+		end();
+	}
+
+	/**
+	 * @brief Allocate cache memory
+	 */
+	bool begin();
+
+	/**
+	 * @brief Write back dirty pages and release cache memory
+	 */
+	void end();
+
+	/**
+	 * @brief Number of pages available
+	 */
+	uint32_t getPageCount() const
+	{
+		auto size = device.getSize();
+		return (size > baseAddress) ? (size - baseAddress) / pageSize : 0;
+	}
+
+	uint16_t getPageSize() const
+	{
+		return pageSize;
+	}
+
+	/**
+	 * @brief Get page content, reading it from the device if necessary
+	 * @param page Page number
+	 * @param forWrite Set if page content will be modified
+	 * @retval uint8_t* Page data, nullptr if page is invalid or all slots are pinned
+	 *
+	 * Page remains in cache until a matching call to `unpin()`.
+	 */
+	uint8_t* pin(uint32_t page, bool forWrite = false);
+
+	/**
+	 * @brief Release a pinned page
+	 * @param page Page number
+	 * @param dirty Set if page content has been modified
+	 */
+	void unpin(uint32_t page, bool dirty = false);
+
+	/**
+	 * @brief Hint that a page will be needed soon
+	 * @retval bool true if page is cached or loading, false if no slot is free
+	 *
+	 * Starts an asynchronous read into a free or clean slot. Does not block.
+	 */
+	bool prefetch(uint32_t page);
+
+	/**
+	 * @brief Write all dirty pages to the device
+	 * @param wait true to block until writes have completed
+	 *
+	 * Pinned pages are skipped: they're written back after release.
+	 */
+	void flush(bool wait = true);
+
+	/**
+	 * @brief Read data spanning any number of pages
+	 */
+	bool read(uint32_t address, void* buffer, size_t len);
+
+	/**
+	 * @brief Write data spanning any number of pages
+	 */
+	bool write(uint32_t address, const void* data, size_t len);
+
+	const Stats& getStats() const
+	{
+		return stats;
+	}
+
+	void clearStats()
+	{
+		stats.clear();
+	}
+
+private:
+	static constexpr uint32_t noPage{0xffffffff};
+
+	struct Slot {
+		Request req;
+		uint8_t* data;
+		uint32_t page;
+		uint32_t lastUse;
+		uint8_t pinCount;
+		bool dirty;
+		bool prefetched;
+	};
+
+	int findSlot(uint32_t page) const;
+	int getVictim(bool mayWrite);
+	uint8_t* pinEmpty(uint32_t page);
+	void load(Slot& slot, uint32_t page);
+	void writeBack(Slot& slot);
+	uint32_t getAddress(uint32_t page) const
+	{
+		return baseAddress + page * pageSize;
+	}
+
+	MemoryDevice& device;
+	Slot* slots{nullptr};
+	uint8_t* buffer{nullptr};
+	uint16_t pageSize;
+	uint8_t cacheSize;
+	uint32_t baseAddress;
+	uint32_t useCounter{0};
+	Stats stats{};
+};
+
+} // namespace HSPI
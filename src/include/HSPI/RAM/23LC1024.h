@@ -0,0 +1,52 @@
+/****
+ * 23LC1024.h
+ *
+ * Copyright 2021 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the HardwareSPI Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#pragma once
+
+#include "../GenericMemory.h"
+
+namespace HSPI
+{
+namespace RAM
+{
+/*
+ * Device powers up in sequential mode. Reads in SDI/SQI modes have one dummy byte.
+ */
+inline constexpr MemoryDescriptor mc23lc1024Descriptor{
+	128 * 1024, // size
+	24,			// addrBits
+	0,			// pageSize
+	0,			// maxSelectTime
+	{},			// reset
+	{
+		// ioMode, read, dummy, write, enter, exit
+		{IoMode::SPIHD, 0x03, 0, 0x02, 0x00, 0x00},
+		{IoMode::SDI, 0x03, 4, 0x02, 0x3B, 0xFF}, // EDIO, RSTIO
+		{IoMode::SQI, 0x03, 2, 0x02, 0x38, 0xFF}, // EQIO, RSTIO
+	},
+};
+
+/**
+ * @brief Microchip 23LC1024 / 23A1024 serial SRAM
+ * @ingroup hw_spi
+ */
+using MC23LC1024 = GenericMemory<mc23lc1024Descriptor>;
+
+} // namespace RAM
+} // namespace HSPI
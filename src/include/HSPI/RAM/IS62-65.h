@@ -21,20 +21,34 @@
 
 #pragma once
 
-#include "../MemoryDevice.h"
+#include "../GenericMemory.h"
 
 namespace HSPI
 {
 namespace RAM
 {
+inline constexpr MemoryDescriptor is62_65Descriptor{
+	256 * 1024, // size
+	24,			// addrBits
+	0,			// pageSize: Sequential mode
+	0,			// maxSelectTime
+	{},			// reset
+	{
+		// ioMode, read, dummy, write, enter, exit
+		{IoMode::SPIHD, 0x03, 8, 0x02, 0x00, 0x00},
+		{IoMode::SDI, 0x03, 4, 0x02, 0x3B, 0xFF}, // Enter SDI, Reset SDI/SQI
+		{IoMode::SQI, 0x03, 2, 0x02, 0x38, 0xFF}, // Enter SQI, Reset SDI/SQI
+	},
+};
+
 /**
  * @brief IS62/65WVS2568GALL fast serial RAM
  * @ingroup hw_spi
  */
-class IS62_65 : public MemoryDevice
+class IS62_65 : public GenericMemory<is62_65Descriptor>
 {
 public:
-	using MemoryDevice::MemoryDevice;
+	using GenericMemory::GenericMemory;
 
 	/**
 	 * @brief Memory operating mode determines how read/write operations are performed
@@ -45,37 +59,15 @@ public:
 		Sequential = 0x40, ///< Access entire memory array (DEFAULT)
 	};
 
-	size_t getSize() const override
-	{
-		return 256 * 1024;
-	}
-
-	IoModes getSupportedIoModes() const override
-	{
-		return IoMode::SPIHD | IoMode::SDI | IoMode::SQI;
-	}
-
 	/**
 	 * @brief Configure the RAM into a known operating mode
 	 */
 	bool begin(PinSet pinSet, uint8_t chipSelect, uint32_t clockSpeed)
 	{
-		if(!MemoryDevice::begin(pinSet, chipSelect, clockSpeed)) {
+		if(!GenericMemory::begin(pinSet, chipSelect, clockSpeed)) {
 			return false;
 		}
 
-		setBitOrder(MSBFIRST);
-		setClockMode(ClockMode::mode0);
-
-		// Ensure device is in SPI mode
-		MemoryDevice::setIoMode(IoMode::SQI);
-		Request req;
-		req.out.set8(0xFF);
-		execute(req);
-		MemoryDevice::setIoMode(IoMode::SDI);
-		execute(req);
-		MemoryDevice::setIoMode(IoMode::SPIHD);
-
 		debug_i("RDMR = 0x%08x", getOpMode());
 
 		setOpMode(OpMode::Sequential);
@@ -84,33 +76,30 @@ public:
 		return true;
 	}
 
-	bool setIoMode(IoMode mode) override
+	/**
+	 * @brief Configure the RAM without blocking
+	 * @see GenericMemory::beginAsync()
+	 *
+	 * Mode register and SQI mode commands are queued behind the initialisation sequence.
+	 */
+	bool beginAsync(PinSet pinSet, uint8_t chipSelect, uint32_t clockSpeed, InterruptDelegate callback = nullptr)
 	{
-		auto oldMode = MemoryDevice::getIoMode();
-		if(oldMode == mode) {
-			return true;
-		}
-
-		if(!isSupported(mode)) {
-			debug_e("setIoMode(): Mode %u invalid", unsigned(mode));
+		if(!GenericMemory::beginAsync(pinSet, chipSelect, clockSpeed, callback)) {
 			return false;
 		}
 
-		Request req;
-		if(oldMode != IoMode::SPIHD) {
-			req.out.set8(0xFF); // Exit SDI/SQI mode
-			execute(req);
-			MemoryDevice::setIoMode(IoMode::SPIHD);
-		}
-
-		if(mode != IoMode::SPIHD) {
-			req.out.set8((mode == IoMode::SDI) ? 0x3B : 0x38);
-			execute(req);
-		}
+		setOpMode(OpMode::Sequential);
+		setIoMode(IoMode::SQI);
 
-		return MemoryDevice::setIoMode(mode);
+		return true;
 	}
 
+	/**
+	 * @brief Set operating mode
+	 *
+	 * The mode register write, and any IO mode switches it requires, are queued without blocking.
+	 * Requests prepared after this call use the new mode.
+	 */
 	void setOpMode(OpMode mode)
 	{
 		auto savedIoMode = getIoMode();
@@ -120,10 +109,7 @@ public:
 		}
 
 		debug_i("WRMR(%u)", unsigned(mode));
-		Request req;
-		req.setCommand8(0x01); // WRMR
-		req.out.set8(uint8_t(mode));
-		execute(req);
+		queueCommand(IoMode::SPIHD, 0x01, uint8_t(mode)); // WRMR
 		this->opMode = mode;
 
 		setIoMode(savedIoMode);
@@ -160,20 +146,11 @@ public:
 		return opMode;
 	}
 
-	void prepareWrite(HSPI::Request& req, uint32_t address) override
-	{
-		wait(req);
-		req.setCommand8(0x02); // Write
-		req.setAddress24(address);
-		req.dummyLen = 0;
-	}
-
-	void prepareRead(HSPI::Request& req, uint32_t address) override
+protected:
+	bool canMergeRequests() const override
 	{
-		wait(req);
-		req.setCommand8(0x03); // Read
-		req.setAddress24(address);
-		req.dummyLen = 8 / getBitsPerClock();
+		// Byte and page modes wrap addresses
+		return opMode == OpMode::Sequential;
 	}
 
 private:
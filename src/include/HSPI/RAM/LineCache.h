@@ -0,0 +1,123 @@
+/****
+ * LineCache.h
+ *
+ * Copyright 2021 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the HardwareSPI Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#pragma once
+
+#include "PSRAM64.h"
+
+namespace HSPI
+{
+namespace RAM
+{
+/**
+ * @brief Direct-mapped cache of 32-byte lines in front of a PSRAM64
+ *
+ * On a miss only the requested bytes are read before returning. The rest of the line is then
+ * read asynchronously, and is waited for only when that line is next accessed or another miss occurs.
+ * Plain reads are used so the device stays in linear mode, and other transfers aren't split at line boundaries.
+ *
+ * Writes go straight to the device, updating any cached copy.
+ *
+ * @note All methods must be called from task context
+ *
+ * @ingroup hw_spi
+ */
+class LineCache
+{
+public:
+	static constexpr uint8_t lineSize{PSRAM64::lineSize};
+
+	struct Stats {
+		uint32_t hits;
+		uint32_t misses; ///< Lines read from device
+
+		void clear()
+		{
+			*this = {};
+		}
+	};
+
+	/**
+	 * @param device
+	 * @param lineCount Number of lines held in RAM, a power of 2
+	 */
+	LineCache(PSRAM64& device, uint16_t lineCount = 32) : device(device), lineCount(lineCount)
+	{
+	}
+
+	~LineCache()
+	{
+		end();
+	}
+
+	/**
+	 * @brief Allocate cache memory
+	 */
+	bool begin();
+
+	/**
+	 * @brief Release cache memory
+	 */
+	void end();
+
+	/**
+	 * @brief Read data, filling lines from the device as required
+	 */
+	bool read(uint32_t address, void* buffer, size_t len);
+
+	/**
+	 * @brief Write data through to the device
+	 */
+	bool write(uint32_t address, const void* data, size_t len);
+
+	/**
+	 * @brief Discard all cached lines
+	 *
+	 * Call if device content has been changed other than via this cache.
+	 */
+	void invalidate();
+
+	const Stats& getStats() const
+	{
+		return stats;
+	}
+
+	void clearStats()
+	{
+		stats.clear();
+	}
+
+private:
+	static constexpr uint32_t noLine{0xffffffff};
+	static constexpr uint16_t noIndex{0xffff};
+
+	const uint8_t* getLine(uint32_t address, size_t count);
+	void waitFill();
+
+	PSRAM64& device;
+	uint8_t* buffer{nullptr};
+	uint32_t* tags{nullptr};
+	uint16_t lineCount;
+	Request fillReq[2]; ///< Parts of line before and after the requested bytes
+	uint16_t fillIndex{noIndex}; ///< Line with fill in progress
+	Stats stats{};
+};
+
+} // namespace RAM
+} // namespace HSPI
@@ -21,61 +21,82 @@
 
 #pragma once
 
-#include "../MemoryDevice.h"
+#include "../GenericMemory.h"
 
 namespace HSPI
 {
 namespace RAM
 {
+inline constexpr MemoryDescriptor psram64Descriptor{
+	8 * 1024 * 1024, // size
+	24,				 // addrBits
+	1024,			 // pageSize
+	8000,			 // maxSelectTime: tCEM
+	{0x66, 0x99},	// reset: Reset Enable, Reset
+	{
+		// ioMode, read, dummy, write, enter, exit
+		{IoMode::SPIHD, 0x0B, 8, 0x02, 0x00, 0x00}, // Fast Read, Write
+		{IoMode::QIO, 0xEB, 6, 0x38, 0x00, 0x00},   // Fast Read Quad, Quad Write
+		{IoMode::SQI, 0xEB, 6, 0x38, 0x35, 0xF5},   // Enter/Exit Quad Mode
+	},
+};
+
 /**
  * @brief PSRAM64(H) pseudo-SRAM
+ *
+ * Transfers are split at 1KB page boundaries, and into transactions short enough to meet tCEM at the current clock speed.
+ *
+ * The device can also wrap bursts within 32-byte lines, so a line may be read starting at the
+ * byte required first (critical word first). See readLine().
+ *
  * @ingroup hw_spi
  */
-class PSRAM64 : public MemoryDevice
+class PSRAM64 : public GenericMemory<psram64Descriptor>
 {
 public:
-	using MemoryDevice::MemoryDevice;
+	static constexpr uint8_t lineSize{32}; ///< Wrap length in line mode
 
-	size_t getSize() const override
-	{
-		return 8 * 1024 * 1024;
-	}
-
-	IoModes getSupportedIoModes() const override
-	{
-		return IoModes(IoMode::SPIHD | IoMode::QIO | IoMode::SQI);
-	}
+	using GenericMemory::GenericMemory;
 
 	/**
 	 * @brief Configure the RAM into a known operating mode
 	 */
 	bool begin(PinSet pinSet, uint8_t chipSelect, uint32_t clockSpeed)
 	{
-		if(!MemoryDevice::begin(pinSet, chipSelect, clockSpeed)) {
+		if(!GenericMemory::begin(pinSet, chipSelect, clockSpeed)) {
 			return false;
 		}
 
-		setBitOrder(MSBFIRST);
-		setClockMode(ClockMode::mode0);
+		// Reset restores linear bursts
+		wrapped = false;
+		pageSize = descriptor.pageSize;
 
-		// Exit QUAD mode
-		MemoryDevice::setIoMode(IoMode::SQI);
-		Request req;
-		req.setCommand8(0xF5);
-		execute(req);
-		MemoryDevice::setIoMode(IoMode::SPIHD);
+		readId();
 
-		// Issue RESET
-		req.setCommand8(0x66);
-		execute(req);
-		req.setCommand8(0x99);
-		execute(req);
+		return true;
+	}
 
-		readId();
+	/**
+	 * @brief Configure the RAM without blocking
+	 * @see GenericMemory::beginAsync()
+	 */
+	bool beginAsync(PinSet pinSet, uint8_t chipSelect, uint32_t clockSpeed, InterruptDelegate callback = nullptr)
+	{
+		if(!GenericMemory::beginAsync(pinSet, chipSelect, clockSpeed, callback)) {
+			return false;
+		}
 
+		wrapped = false;
+		pageSize = descriptor.pageSize;
 		return true;
 	}
 
+	/**
+	 * @brief Read device ID
+	 *
+	 * Requires SPIHD mode, so if necessary mode switch commands are queued either side of the read.
+	 * Only the read itself blocks.
+	 */
 	uint8_t readId()
 	{
 		auto savedIoMode = getIoMode();
@@ -98,49 +119,68 @@ public:
 		return buffer[0];
 	}
 
-	bool setIoMode(IoMode mode) override
+	/**
+	 * @brief Select wrap length for bursts
+	 * @param lineMode true to wrap within 32-byte lines, false for 1KB pages
+	 *
+	 * The wrap toggle command is queued without blocking, ahead of any subsequent requests.
+	 * Other transfers remain valid in line mode as they're split at line boundaries,
+	 * but use more transactions.
+	 */
+	void setLineMode(bool lineMode)
 	{
-		auto oldMode = MemoryDevice::getIoMode();
-		if(oldMode == mode) {
-			return true;
-		}
-
-		if(!isSupported(mode)) {
-			debug_e("setIoMode(): Mode %u invalid", unsigned(mode));
-			return false;
-		}
-
-		Request req;
-		if(oldMode == IoMode::SQI) {
-			req.setCommand8(0xF5); // Exit Quad Mode
-			execute(req);
-		} else if(mode == IoMode::SQI) {
-			req.setCommand8(0x35); // Enter Quad Mode
-			execute(req);
+		if(lineMode == wrapped) {
+			return;
 		}
+		queueCommand(getIoMode(), 0xC0); // Wrap Boundary Toggle
+		wrapped = lineMode;
+		pageSize = wrapped ? lineSize : descriptor.pageSize;
+	}
 
-		return MemoryDevice::setIoMode(mode);
+	bool isLineMode() const
+	{
+		return wrapped;
 	}
 
-	void prepareWrite(HSPI::Request& req, uint32_t address) override
+	/**
+	 * @brief Read from a 32-byte line, starting at any byte and wrapping to the start of the line
+	 * @param req
+	 * @param address First byte required
+	 * @param buffer On completion, `buffer[0]` holds the byte at `address`
+	 * @param len Number of bytes, up to `lineSize`
+	 * @param callback
+	 * @param param
+	 *
+	 * Switches to line mode if necessary.
+	 */
+	void readLine(Request& req, uint32_t address, void* buffer, size_t len = lineSize, Callback callback = nullptr,
+				  void* param = nullptr)
 	{
-		bool quad = (getIoMode() != IoMode::SPIHD);
-		wait(req);
-		req.setCommand8(quad ? 0x38 : 0x02);
-		req.setAddress24(address);
-		req.dummyLen = 0;
+		prepareLine(req, address, buffer, len);
+		req.setAsync(callback, param);
+		execute(req);
 	}
 
-	void prepareRead(HSPI::Request& req, uint32_t address) override
+	/**
+	 * @brief Read from a 32-byte line (blocking)
+	 */
+	void readLine(uint32_t address, void* buffer, size_t len = lineSize)
 	{
-		bool quad = (getIoMode() != IoMode::SPIHD);
-		wait(req);
-		req.setCommand8(quad ? 0xEB : 0x0B);
-		req.setAddress24(address);
-		req.dummyLen = quad ? 6 : 8;
+		Request req;
+		prepareLine(req, address, buffer, len);
+		execute(req);
 	}
 
 private:
+	void prepareLine(Request& req, uint32_t address, void* buffer, size_t len)
+	{
+		setLineMode(true);
+		MemoryDevice::prepareRead(req, address, buffer, std::min(len, size_t(lineSize)));
+		req.merge = false;
+		req.wrap = true;
+	}
+
+	bool wrapped{false};
 	HSPI::Request req1;
 	HSPI::Request req2;
 };
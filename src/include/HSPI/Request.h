@@ -24,6 +24,7 @@
 
 #pragma once
 
+#include "Common.h"
 #include "Data.h"
 #include <cstddef>
 
@@ -35,7 +36,8 @@ struct Request;
 /**
  * @brief SPI completion callback routine
  * @param request
- * @retval bool Return true if request is finished, false to re-queue it immediately
+ * @retval bool Return true if request is finished, false to re-queue it.
+ * If `Request::requeueDelay` is set the request is held back for that long before being re-queued.
  * @ingroup hw_spi
  */
 using Callback = bool (*)(Request& request);
@@ -62,7 +64,15 @@ struct Request {
 	uint8_t async : 1;			  ///< Set for asynchronous operation
 	uint8_t task : 1;			  ///< Controller will execute this request in task mode
 	volatile uint8_t busy : 1;	///< Request in progress
+	uint8_t merge : 1;			  ///< Controller may combine with adjacent requests - see mergeRequests()
+	uint8_t verify : 1; ///< Compare incoming data against `in` buffer instead of storing it. See MemoryDevice::verify()
+	uint8_t calcCrc : 1;		  ///< Update `crc` with data as it's transferred. See enableCrc()
+	uint8_t overrideIoMode : 1;   ///< Use `ioMode` instead of device setting. See setIoMode()
+	uint8_t parked : 1;			  ///< Controller is holding request until `dueTime`. See parkRequest()
+	uint8_t wrap : 1;			  ///< Device address wraps to start of `pageSize` boundary, so transactions may run through it
+	IoMode ioMode{};			  ///< IO mode for this request. Taken from device on execution unless `overrideIoMode` is set.
 	size_t maxTransactionSize{0}; ///< Limit size of data in each transaction (excludes command/address/dummy)
+	uint16_t pageSize{0};		  ///< Transactions don't cross this address boundary, a power of 2. 0 for no limit.
 	uint32_t addr{0};			  ///< Address value
 	uint8_t addrLen{0};			  ///< Address bits, 0 - 32
 	uint8_t dummyLen{0};		  ///< Dummy read bits between address and read data, 0 - 255
@@ -70,8 +80,13 @@ struct Request {
 	Data in;					  ///< Incoming data
 	Callback callback{nullptr};   ///< Completion routine
 	void* param{nullptr};		  ///< User parameter
+	uint32_t crc{0};			  ///< Running CRC32 of data transferred, if `calcCrc` is set
+	uint32_t requeueDelay{0};	 ///< Microseconds to wait before re-queuing, when callback returns false
+	uint32_t dueTime{0};		  ///< Time when parked request may be re-queued
 
-	Request() : async(false), task(false), busy(false)
+	Request()
+		: async(false), task(false), busy(false), merge(false), verify(false), calcCrc(false), overrideIoMode(false),
+		  parked(false), wrap(false)
 	{
 	}
 
@@ -136,6 +151,70 @@ struct Request {
 
 	/** @} */
 
+	/**
+	 * @brief Get size of data for a transaction starting at the given address
+	 * @param address Device address for the transaction
+	 * @retval size_t Limited by `maxTransactionSize` and `pageSize`
+	 *
+	 * If `wrap` is set the device wraps at the page boundary, so only `maxTransactionSize` applies.
+	 */
+	__forceinline size_t getTransactionLimit(uint32_t address) const
+	{
+		if(pageSize == 0 || wrap) {
+			return maxTransactionSize;
+		}
+		size_t pageRemain = pageSize - (address & (pageSize - 1));
+		return (pageRemain < maxTransactionSize) ? pageRemain : maxTransactionSize;
+	}
+
+	/**
+	 * @brief Get device address for the transaction following one of the given length
+	 * @param address Start address of completed transaction
+	 * @param length Data length of completed transaction
+	 */
+	__forceinline uint32_t getNextAddress(uint32_t address, size_t length) const
+	{
+		if(wrap) {
+			uint32_t mask = pageSize - 1;
+			return (address & ~mask) | ((address + length) & mask);
+		}
+		return address + length;
+	}
+
+	/**
+	 * @brief Use a specific IO mode for this request
+	 *
+	 * For example, flash devices use 1-bit transfers for status and erase commands
+	 * but dual or quad transfers for reading data.
+	 */
+	void setIoMode(IoMode mode)
+	{
+		ioMode = mode;
+		overrideIoMode = true;
+	}
+
+	/**
+	 * @brief Revert to using device IO mode setting
+	 */
+	void clearIoMode()
+	{
+		overrideIoMode = false;
+	}
+
+	/**
+	 * @brief Calculate CRC32 of data as it's transferred
+	 * @param initial Starting value. Use result from a previous request to continue the calculation.
+	 *
+	 * The controller updates `crc` for each chunk of outgoing data as it's queued, and incoming data
+	 * as it's received. For verify requests only outgoing data is included.
+	 * Requests with CRC enabled are not merged.
+	 */
+	void enableCrc(uint32_t initial = 0)
+	{
+		calcCrc = true;
+		crc = initial;
+	}
+
 	/**
 	 * @brief Set request to asynchronous execution with optional callback
 	 */
@@ -166,4 +245,66 @@ struct Request {
  */
 Request* reQueueRequest(Request* head, Request* request);
 
+/**
+ * @brief Support function to re-queue a request after a delay
+ * @param head The current queue head
+ * @param parked List of parked requests
+ * @param request The request to park
+ * @param now Current time in microseconds
+ * @retval Request* The new queue head
+ *
+ * The request is held in the parked list until `request->requeueDelay` has elapsed.
+ * Any queued requests for the same device are parked with it so device order is preserved,
+ * and the bus remains available to other devices in the meantime.
+ *
+ * Use this to poll a device status without occupying the bus or the CPU.
+ */
+Request* parkRequest(Request* head, Request*& parked, Request* request, uint32_t now);
+
+/**
+ * @brief Park a request behind any parked request for the same device
+ * @param parked List of parked requests
+ * @param request
+ * @retval bool true if request was parked, false if there's nothing parked for the device
+ */
+bool joinParked(Request*& parked, Request* request);
+
+/**
+ * @brief Move parked requests which are due back onto the end of the queue
+ * @param head The current queue head
+ * @param parked List of parked requests
+ * @param now Current time in microseconds
+ * @retval Request* The new queue head
+ */
+Request* releaseRequests(Request* head, Request*& parked, uint32_t now);
+
+/**
+ * @brief Get time until the next parked request is due
+ * @param parked List of parked requests, must not be empty
+ * @param now Current time in microseconds
+ * @retval uint32_t Microseconds, 0 if a request is due now
+ */
+uint32_t getParkedDelay(const Request* parked, uint32_t now);
+
+/**
+ * @brief Support function to combine queued requests into a single burst
+ * @param request The request about to be started, at the head of the queue
+ * @retval Request* The final request merged, nullptr if none
+ *
+ * Looks for queued requests which continue on from `request`: same device and command,
+ * following address and data buffer, same direction. Both must have the `merge` flag set.
+ * Only the next request for the device is considered at each step so device order is preserved.
+ *
+ * Merged requests are moved to follow `request` in the queue and its data length extended to cover them.
+ * When the burst completes, call `splitRequests()` before completing each request individually.
+ */
+Request* mergeRequests(Request& request);
+
+/**
+ * @brief Restore a request after a merged burst has completed
+ * @param request The request passed to `mergeRequests()`
+ * @param tail The value returned from `mergeRequests()`
+ */
+void splitRequests(Request& request, Request& tail);
+
 } // namespace HSPI
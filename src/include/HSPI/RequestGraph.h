@@ -0,0 +1,139 @@
+/****
+ * RequestGraph.h
+ *
+ * Copyright 2021 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the HardwareSPI Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#pragma once
+
+#include "Device.h"
+#include <Interrupts.h>
+
+namespace HSPI
+{
+/**
+ * @brief Runs a set of requests with dependencies between them
+ *
+ * Each node is a prepared request, which is started once all the nodes it depends on have completed.
+ * Successors are executed from the completion callback, so the controller queues them as soon as completion
+ * processing has finished without going via the task queue. Nodes without dependencies are started together.
+ *
+ * Typical uses are write then verify, read-modify-write and command then poll.
+ *
+ * A node's own completion callback, if any, is called first and may return false to re-queue the request
+ * (e.g. to poll a status register). Successors are started when it returns true.
+ * It's called in interrupt context, so must be in IRAM.
+ *
+ * Requests, devices and data buffers must remain valid until the graph has completed.
+ * The IO mode for each request is taken from its device when the node is started.
+ *
+ * @ingroup hw_spi
+ */
+class RequestGraph
+{
+public:
+	static constexpr uint8_t maxNodes{32};
+
+	/**
+	 * @brief Set of nodes, bit 0 for the first node added
+	 */
+	using Mask = uint32_t;
+
+	~RequestGraph();
+
+	/**
+	 * @brief Add a node to the graph
+	 * @param device Device to execute request on
+	 * @param request Prepared request, with optional completion callback
+	 * @param dependsOn Nodes which must complete before this one starts, which must already have been added
+	 * @retval int Index of the node, or -1 on error
+	 */
+	int add(Device& device, Request& request, Mask dependsOn = 0);
+
+	/**
+	 * @brief Get mask value for a node
+	 * @param node Value returned from `add()`
+	 */
+	static constexpr Mask bit(int node)
+	{
+		return Mask(1) << node;
+	}
+
+	/**
+	 * @brief Start executing the graph
+	 * @param callback Invoked in task context when all nodes have completed
+	 * @retval bool false if graph is empty or already running
+	 */
+	bool execute(InterruptDelegate callback = nullptr);
+
+	/**
+	 * @brief Determine if graph is still running
+	 */
+	bool isBusy() const
+	{
+		return remaining != 0;
+	}
+
+	/**
+	 * @brief Block until all nodes have completed
+	 *
+	 * Only nodes which have been started are waited on. The completion callback is invoked
+	 * before returning if it hasn't been already.
+	 */
+	void wait();
+
+	/**
+	 * @brief Remove all nodes so the graph may be re-used
+	 * @note Waits for completion first
+	 */
+	void clear();
+
+	uint8_t getNodeCount() const
+	{
+		return nodeCount;
+	}
+
+private:
+	struct Node {
+		Device* device;
+		Request* request;
+		Callback callback; ///< Request's own callback
+		void* param;
+		Mask dependsOn;
+		uint8_t pending; ///< Count of dependencies not yet completed
+	};
+
+	/*
+	 * Passed to the completion task instead of the graph itself,
+	 * so the graph may be destroyed whilst the task is still queued
+	 */
+	struct TaskToken {
+		RequestGraph* graph;
+	};
+
+	void complete();
+	static bool requestComplete(Request& request);
+
+	Node nodes[maxNodes];
+	uint8_t nodeCount{0};
+	volatile Mask remaining{0};
+	volatile Mask started{0};
+	InterruptDelegate callback;
+	TaskToken* token{nullptr};
+	volatile bool taskQueued{false};
+};
+
+} // namespace HSPI
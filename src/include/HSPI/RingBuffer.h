@@ -0,0 +1,170 @@
+/****
+ * RingBuffer.h
+ *
+ * Copyright 2021 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the HardwareSPI Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#pragma once
+
+#include "MemoryDevice.h"
+
+namespace HSPI
+{
+/**
+ * @brief FIFO byte buffer stored in a memory device region
+ *
+ * Data is pushed into a RAM head buffer. When full, it's written to the device as a single
+ * asynchronous burst and a second head buffer takes over.
+ *
+ * Data is popped directly from the head buffers if it hasn't yet been written.
+ * Otherwise it's served from two tail buffers which are read from the device asynchronously
+ * ahead of the consumer.
+ *
+ * Neither `push()` nor `pop()` wait for the bus. If a head buffer is still being written then
+ * `push()` accepts fewer bytes, and if a tail buffer is still loading then `pop()` returns fewer bytes.
+ *
+ * @note Region capacity and buffer size must both be powers of 2.
+ * Methods must be called from task context.
+ *
+ * @ingroup hw_spi
+ */
+class RingBuffer
+{
+public:
+	struct Stats {
+		uint32_t blocksWritten; ///< Head buffers written to device
+		uint32_t blocksRead;	///< Tail buffers read from device
+		uint32_t pushStalls;	///< Push truncated because head buffer was busy
+		uint32_t popStalls;		///< Pop truncated because tail buffer wasn't ready
+		uint32_t bytesFromHead; ///< Bytes popped directly from head buffers
+
+		void clear()
+		{
+			*this = {};
+		}
+	};
+
+	/**
+	 * @param device
+	 * @param baseAddress Start of device region
+	 * @param capacity Size of device region
+	 * @param bufferSize Size of each RAM buffer, up to 16384
+	 */
+	RingBuffer(MemoryDevice& device, uint32_t baseAddress, uint32_t capacity, uint16_t bufferSize = 512)
+		: device(device), baseAddress(baseAddress), capacity(capacity), bufferSize(bufferSize)
+	{
+	}
+
+	~RingBuffer()
+	{
+		end();
+	}
+
+	/**
+	 * @brief Allocate buffers and empty the FIFO
+	 * @retval bool false if parameters are invalid
+	 */
+	bool begin();
+
+	/**
+	 * @brief Wait for outstanding requests and release buffers
+	 */
+	void end();
+
+	/**
+	 * @brief Discard content
+	 */
+	void clear();
+
+	/**
+	 * @brief Add data to the FIFO
+	 * @retval size_t Number of bytes accepted
+	 */
+	size_t push(const void* data, size_t len);
+
+	/**
+	 * @brief Remove data from the FIFO
+	 * @retval size_t Number of bytes returned
+	 */
+	size_t pop(void* buffer, size_t len);
+
+	/**
+	 * @brief Number of bytes stored
+	 */
+	size_t available() const
+	{
+		return pushPos - popPos;
+	}
+
+	/**
+	 * @brief Number of bytes which may be pushed
+	 */
+	size_t space() const
+	{
+		return capacity - available();
+	}
+
+	uint32_t getCapacity() const
+	{
+		return capacity;
+	}
+
+	const Stats& getStats() const
+	{
+		return stats;
+	}
+
+	void clearStats()
+	{
+		stats.clear();
+	}
+
+private:
+	static constexpr unsigned bufCount{2};
+
+	uint32_t getAddress(uint32_t pos) const
+	{
+		return baseAddress + (pos & (capacity - 1));
+	}
+
+	uint32_t getBlock(uint32_t pos) const
+	{
+		return pos & ~uint32_t(bufferSize - 1);
+	}
+
+	bool writeHead();
+	const uint8_t* locate(uint32_t pos, size_t& avail);
+	void prefetch();
+
+	MemoryDevice& device;
+	uint8_t* buffer{nullptr};
+	uint32_t baseAddress;
+	uint32_t capacity;
+	uint16_t bufferSize;
+	// Stream positions, modulo 2^32
+	uint32_t pushPos{0};
+	uint32_t popPos{0};
+	uint32_t headStart{0}; ///< Stream position for start of current head buffer
+	uint16_t headLen{0};
+	uint8_t headIndex{0};
+	uint32_t tailStart[bufCount]{};
+	bool tailValid[bufCount]{};
+	Request headReq[bufCount];
+	Request tailReq[bufCount];
+	Stats stats{};
+};
+
+} // namespace HSPI
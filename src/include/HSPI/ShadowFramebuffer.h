@@ -0,0 +1,208 @@
+/****
+ * ShadowFramebuffer.h
+ *
+ * Copyright 2021 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the HardwareSPI Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#pragma once
+
+#include "MemoryDevice.h"
+#include <Interrupts.h>
+
+namespace HSPI
+{
+/**
+ * @brief RAM copy of a framebuffer held in device memory, uploading only changed areas
+ *
+ * The application draws into the shadow buffer and marks changed areas dirty.
+ * The display area is divided into square tiles and a bit is kept for each one.
+ *
+ * On `update()` dirty tiles are combined into rectangles: the first dirty tile is extended across
+ * the row as far as possible, then downwards while the tiles below are also dirty.
+ * Each rectangle is written using MemoryDevice::writeRect().
+ * Uploads are asynchronous, with the next rectangle started from task context.
+ *
+ * @note Areas changed during an update are uploaded on the next one, as long as they are marked dirty.
+ *
+ * @ingroup hw_spi
+ */
+class ShadowFramebuffer
+{
+public:
+	struct Stats {
+		uint32_t updates;		///< Calls to update() which uploaded data
+		uint32_t rects;			///< Rectangles written
+		uint32_t tiles;			///< Tiles written
+		uint32_t bytesUploaded; ///< Pixel data written
+
+		void clear()
+		{
+			*this = {};
+		}
+	};
+
+	/**
+	 * @param device
+	 * @param address Device address of framebuffer
+	 * @param width Pixels per line
+	 * @param height Number of lines
+	 * @param bytesPerPixel
+	 * @param tileSize Width and height of a tile, in pixels
+	 */
+	ShadowFramebuffer(MemoryDevice& device, uint32_t address, uint16_t width, uint16_t height, uint8_t bytesPerPixel,
+					  uint8_t tileSize = 16)
+		: device(device), address(address), width(width), height(height), bytesPerPixel(bytesPerPixel),
+		  tileSize(tileSize)
+	{
+	}
+
+	~ShadowFramebuffer()
+	{
+		end();
+	}
+
+	/**
+	 * @brief Allocate shadow buffer
+	 * @param load true to read initial content from device, otherwise the whole buffer is marked dirty
+	 */
+	bool begin(bool load = false);
+
+	/**
+	 * @brief Wait for any update to complete and release memory
+	 */
+	void end();
+
+	uint8_t* getBuffer()
+	{
+		return buffer;
+	}
+
+	/**
+	 * @brief Bytes per line in both shadow buffer and device
+	 */
+	uint16_t getStride() const
+	{
+		return width * bytesPerPixel;
+	}
+
+	uint16_t getWidth() const
+	{
+		return width;
+	}
+
+	uint16_t getHeight() const
+	{
+		return height;
+	}
+
+	/**
+	 * @brief Get location of a pixel in the shadow buffer
+	 */
+	uint8_t* getPixel(uint16_t x, uint16_t y)
+	{
+		return &buffer[(y * width + x) * bytesPerPixel];
+	}
+
+	/**
+	 * @brief Mark an area as changed
+	 */
+	void markDirty(uint16_t x, uint16_t y, uint16_t w, uint16_t h);
+
+	/**
+	 * @brief Mark entire buffer as changed
+	 */
+	void markAllDirty()
+	{
+		markDirty(0, 0, width, height);
+	}
+
+	/**
+	 * @brief Copy a block of pixel data into the shadow buffer and mark it dirty
+	 * @param data Pixel data, `w * bytesPerPixel` bytes per line
+	 */
+	void writeRect(uint16_t x, uint16_t y, uint16_t w, uint16_t h, const void* data);
+
+	/**
+	 * @brief Start uploading dirty areas to the device
+	 * @param callback Invoked when upload has completed
+	 * @retval bool false if an update is already in progress
+	 */
+	bool update(InterruptDelegate callback = nullptr);
+
+	/**
+	 * @brief Wait for update to complete
+	 */
+	void wait();
+
+	bool isBusy() const
+	{
+		return active;
+	}
+
+	const Stats& getStats() const
+	{
+		return stats;
+	}
+
+	void clearStats()
+	{
+		stats.clear();
+	}
+
+private:
+	struct TileRect {
+		uint16_t x;
+		uint16_t y;
+		uint16_t w;
+		uint16_t h;
+	};
+
+	bool isDirty(unsigned tx, unsigned ty) const
+	{
+		auto i = ty * tilesX + tx;
+		return dirty[i / 32] & (1U << (i % 32));
+	}
+
+	void clearDirty(unsigned tx, unsigned ty)
+	{
+		auto i = ty * tilesX + tx;
+		dirty[i / 32] &= ~(1U << (i % 32));
+	}
+
+	bool getNextRect(TileRect& rect);
+	bool startNextRect();
+	void task();
+	static bool requestComplete(Request& req);
+
+	MemoryDevice& device;
+	RectRequest req;
+	uint8_t* buffer{nullptr};
+	uint32_t* dirty{nullptr};
+	uint32_t address;
+	uint16_t width;
+	uint16_t height;
+	uint8_t bytesPerPixel;
+	uint8_t tileSize;
+	uint16_t tilesX{0};
+	uint16_t tilesY{0};
+	uint16_t scanRow{0}; ///< Tile row to continue searching from
+	InterruptDelegate callback;
+	volatile bool active{false};
+	volatile bool taskQueued{false};
+	Stats stats{};
+};
+
+} // namespace HSPI
@@ -0,0 +1,74 @@
+/****
+ * StripedMemory.h
+ *
+ * Copyright 2021 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the HardwareSPI Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#pragma once
+
+#include "CompositeMemory.h"
+
+namespace HSPI
+{
+/**
+ * @brief Interleave a unified address space across several memory devices
+ *
+ * Stripe `n` is located on member `n % memberCount` at address `(n / memberCount) * stripeSize`.
+ *
+ * For example, with two PSRAM64 chips and 1K stripes:
+ *
+ * 	0x0000 - 0x03FF: Chip #0 0x0000 - 0x03FF
+ * 	0x0400 - 0x07FF: Chip #1 0x0000 - 0x03FF
+ * 	0x0800 - 0x0BFF: Chip #0 0x0400 - 0x07FF
+ * 	...
+ *
+ * A transfer spanning several stripes runs on all members concurrently.
+ * If the members are attached to separate controllers then throughput scales accordingly.
+ *
+ * @ingroup hw_spi
+ */
+class StripedMemory : public CompositeMemory
+{
+public:
+	static constexpr uint16_t maxStripeSize{0x4000};
+
+	/**
+	 * @param stripeSize Number of bytes in each stripe
+	 */
+	StripedMemory(uint16_t stripeSize) : stripeSize(std::max(uint16_t(1), std::min(stripeSize, maxStripeSize)))
+	{
+	}
+
+	uint16_t getStripeSize() const
+	{
+		return stripeSize;
+	}
+
+	/**
+	 * @brief Combined size is limited by the smallest member
+	 */
+	size_t getSize() const override;
+
+protected:
+	void startOperation() override;
+	bool getSegment(Member& member, Segment& segment) override;
+
+private:
+	uint16_t stripeSize;
+	uint32_t endStripe{0}; ///< One past final stripe for current operation
+};
+
+} // namespace HSPI